@@ -0,0 +1,130 @@
+/*
+ *  Self-benchmark of MPImeasure, results as JSON (stdout or <json-file>):
+ *    - overhead:     ns per DEBUG_MEASURE of an empty region (incl. its share of DEBUG_MEASURE_EOL) per mode
+ *    - reductions:   us per line of the stats reductions vs. number of ranks and regions per line
+ *    - perturbation: us per step of a compute + allreduce kernel without and with measurement
+ *    mpirun -np <n> ./mpimeasure_bench [<n-iterations> [<json-file>]]
+ */
+
+#define DEBUG_MEASURE_ENABLED true
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "MPImeasure.h"
+
+struct Mode {
+  const char* name;
+  size_t flags;
+};
+
+static std::vector<std::string> region_names(size_t n) {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < n; ++i) names.push_back("r" + std::to_string(i));
+  return names;
+}
+
+static double max_over_ranks(double val, CommInfo ci) {
+  double max_val;
+  MPI_Allreduce(&val, &max_val, 1, MPI_DOUBLE, MPI_MAX, ci.comm);
+  return max_val;
+}
+
+// seconds per line of n_regions empty measured regions (max over the ranks)
+static double measured_lines(CommInfo ci, size_t flags, size_t n_regions, long n_lines) {
+  TimeMeasurer* tm = make_TimeMeasurer("/dev/null", flags, region_names(n_regions), ci);
+  MPI_Barrier(ci.comm);
+  double start = MPI_Wtime();
+  for (long line = 0; line < n_lines; ++line) {
+    for (RegionId reg = 0; reg < static_cast<RegionId>(n_regions); ++reg) DEBUG_MEASURE(tm, flags, reg, { });
+    DEBUG_MEASURE_EOL(tm, flags);
+  }
+  double sec = (MPI_Wtime() - start) / n_lines;
+  DEBUG_MEASURE_DESTROY(tm);
+  return max_over_ranks(sec, ci);
+}
+
+// synthetic step: ~work_flops of compute, then an allreduce of 8 doubles
+static double kernel_steps(CommInfo ci, size_t flags, long n_steps, long work) {
+  TimeMeasurer* tm = flags ? make_TimeMeasurer("/dev/null", flags, {"compute", "allreduce"}, ci) : nullptr;
+  double vals[8] = {0.0}, sums[8];
+  volatile double acc = 1.0;
+  MPI_Barrier(ci.comm);
+  double start = MPI_Wtime();
+  for (long step = 0; step < n_steps; ++step) {
+    DEBUG_MEASURE(tm, flags, "compute", {
+      double x = acc;
+      for (long i = 0; i < work; ++i) x = x * 0.999999 + 1e-9;
+      acc = x;
+    });
+    vals[0] = acc;
+    DEBUG_MEASURE(tm, flags, "allreduce", { MPI_Allreduce(vals, sums, 8, MPI_DOUBLE, MPI_SUM, ci.comm); });
+    DEBUG_MEASURE_EOL(tm, flags);
+  }
+  double sec = (MPI_Wtime() - start) / n_steps;
+  DEBUG_MEASURE_DESTROY(tm);
+  return max_over_ranks(sec, ci);
+}
+
+int main(int argc, char* argv[]) {
+  MPI_Init(&argc, &argv);
+  CommInfo ci = CommInfo::getDefault();
+  long n_iter = (argc > 1) ? std::atol(argv[1]) : 100000;
+  FILE* out = (ci.i_am_root() and argc > 2) ? fopen(argv[2], "w") : stdout;
+  if (not out) { fprintf(stderr, "ERROR: unable to open '%s'\n", argv[2]); exit(1); }
+  size_t rt = DbgMeasureMode::RUNTIME, us = DbgMeasureMode::UNSYNCNESS;
+  size_t rs = DbgMeasureMode::ROOT_STAT, ts = DbgMeasureMode::TOTAL_STAT, bs = DbgMeasureMode::BATCH_STAT;
+
+  if (ci.i_am_root()) fprintf(out, "{\n  \"ranks\": %i,\n  \"iterations\": %li,\n", ci.n_ranks, n_iter);
+
+  // per-region overhead; collective modes are dominated by the reductions/barriers -> fewer iterations
+  const Mode modes[] = {{"OFF", DbgMeasureMode::OFF}, {"RUNTIME", rt}, {"UNSYNCNESS", us}, {"RUNTIME|ROOT_STAT", rt | rs},
+                        {"RUNTIME|TOTAL_STAT", rt | ts}, {"RUNTIME|BATCH_STAT", rt | bs}};
+  if (ci.i_am_root()) fprintf(out, "  \"overhead\": [");
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+    bool collective = modes[m].flags & (us | rs | ts | bs);
+    long n = collective ? n_iter / 100 + 1 : n_iter;
+    double ns = measured_lines(ci, modes[m].flags, 1, n) * 1e9;
+    if (ci.i_am_root()) fprintf(out, "%s\n    {\"mode\": \"%s\", \"flags\": %lu, \"ns_per_region\": %.1f}",
+                                m ? "," : "", modes[m].name, modes[m].flags, ns);
+  }
+  if (ci.i_am_root()) fprintf(out, "\n  ],\n");
+
+  // reductions vs. ranks (sub-communicators of the first 1, 2, 4, .. ranks) and regions per line
+  if (ci.i_am_root()) fprintf(out, "  \"reductions\": [");
+  bool first = true;
+  for (int n_ranks = 1; ; n_ranks = std::min(2 * n_ranks, ci.n_ranks)) {
+    MPI_Comm sub;
+    MPI_Comm_split(ci.comm, ci.me < n_ranks ? 0 : MPI_UNDEFINED, ci.me, &sub);
+    for (size_t n_regions : {1, 4, 16, 64}) {
+      for (const Mode& mode : {Mode{"ROOT_STAT", rt | rs}, Mode{"BATCH_STAT", rt | bs}}) {
+        double sec = 0.0;
+        if (sub != MPI_COMM_NULL) sec = measured_lines(CommInfo::getDefault(sub), mode.flags, n_regions, n_iter / 1000 + 1);
+        sec = max_over_ranks(sec, ci);
+        if (ci.i_am_root()) fprintf(out, "%s\n    {\"ranks\": %i, \"regions\": %lu, \"mode\": \"%s\", \"us_per_line\": %.3f}",
+                                    first ? "" : ",", n_ranks, n_regions, mode.name, sec * 1e6);
+        first = false;
+      }
+    }
+    if (sub != MPI_COMM_NULL) MPI_Comm_free(&sub);
+    if (n_ranks == ci.n_ranks) break;
+  }
+  if (ci.i_am_root()) fprintf(out, "\n  ],\n");
+
+  // perturbation of a compute + allreduce kernel (baseline measured before and after to show the noise)
+  const long work = 20000, n_steps = n_iter / 100 + 10;
+  double base = kernel_steps(ci, DbgMeasureMode::OFF, n_steps, work);
+  const Mode kernel_modes[] = {{"RUNTIME", rt}, {"RUNTIME|ROOT_STAT", rt | rs}, {"RUNTIME|BATCH_STAT", rt | bs},
+                               {"RUNTIME|TOTAL_STAT", rt | ts}, {"UNSYNCNESS|ROOT_STAT", us | rs}, {"OFF", DbgMeasureMode::OFF}};
+  if (ci.i_am_root()) fprintf(out, "  \"perturbation\": {\n    \"work\": %li,\n    \"steps\": %li,\n    \"baseline_us_per_step\": %.3f,\n    \"runs\": [",
+                              work, n_steps, base * 1e6);
+  for (size_t m = 0; m < sizeof(kernel_modes) / sizeof(kernel_modes[0]); ++m) {
+    double sec = kernel_steps(ci, kernel_modes[m].flags, n_steps, work);
+    if (ci.i_am_root()) fprintf(out, "%s\n      {\"mode\": \"%s\", \"us_per_step\": %.3f, \"slowdown_pct\": %.2f}",
+                                m ? "," : "", kernel_modes[m].name, sec * 1e6, 100.0 * (sec - base) / base);
+  }
+  if (ci.i_am_root()) fprintf(out, "\n    ]\n  }\n}\n");
+
+  if (out != stdout) fclose(out);
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Microbenchmark: overhead of one measured (empty) region per clock/mode policy in nanoseconds
+ *    mpirun -np <n> ./policy_overhead [<n-iterations>]
+ */
+
+#include <cstdlib>
+#include "MPImeasure.h"
+
+template<class Measurer>
+double region_overhead_ns(Measurer* tm, long n_iter, bool with_write) {
+  const RegionId region = tm->region("reg");
+  MPI_Barrier(MPI_COMM_WORLD);
+  double start = MPI_Wtime();
+  for (long i = 0; i < n_iter; ++i) {
+    tm->before();
+    tm->after(region);
+    if (with_write) tm->write(region);
+  }
+  double ns = (MPI_Wtime() - start) / n_iter * 1e9, max_ns;
+  MPI_Reduce(&ns, &max_ns, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  return max_ns;
+}
+
+template<class Measurer>
+void bench(const char* name, CommInfo ci, size_t flagMask, long n_iter) {
+  Measurer* tm = new Measurer("/dev/null", flagMask, {}, ci);
+  double ns = region_overhead_ns(tm, n_iter, false);
+  double ns_write = region_overhead_ns(tm, n_iter, true);
+  if (ci.i_am_root()) printf("%-40s %12.1f %12.1f\n", name, ns, ns_write);
+  delete tm;
+}
+
+int main(int argc, char* argv[]) {
+  MPI_Init(&argc, &argv);
+  CommInfo ci = CommInfo::getDefault();
+  long n_iter = (argc > 1) ? std::atol(argv[1]) : 1000000;
+  size_t rt = DbgMeasureMode::RUNTIME, us = DbgMeasureMode::UNSYNCNESS;
+
+  if (ci.i_am_root()) printf("%-40s %12s %12s   (ranks: %i, max over ranks)\n", "policy", "ns/region", "+write", ci.n_ranks);
+
+  {   // legacy path: virtual calls through the base pointer
+    TimeMeasurer* tm = make_TimeMeasurer("/dev/null", rt, {}, ci);
+    double ns = region_overhead_ns(tm, n_iter, false);
+    double ns_write = region_overhead_ns(tm, n_iter, true);
+    if (ci.i_am_root()) printf("%-40s %12.1f %12.1f\n", "TimeMeasurer* (virtual, MPIClock)", ns, ns_write);
+    delete tm;
+  }
+  bench<PolicyTimeMeasurer<MPIClock, RunTimeMode>>         ("MPIClock, RunTimeMode",          ci, rt, n_iter);
+  bench<PolicyTimeMeasurer<MonotonicRawClock, RunTimeMode>>("MonotonicRawClock, RunTimeMode", ci, rt, n_iter);
+#if defined(__x86_64__) || defined(__i386__)
+  bench<PolicyTimeMeasurer<TscClock, RunTimeMode>>         ("TscClock, RunTimeMode",          ci, rt, n_iter);
+#endif
+  // sync mode is dominated by the two barriers -> fewer iterations
+  bench<PolicyTimeMeasurer<MPIClock, SyncMode>>            ("MPIClock, SyncMode",             ci, us, n_iter / 100 + 1);
+#if defined(__x86_64__) || defined(__i386__)
+  bench<PolicyTimeMeasurer<TscClock, SyncMode>>            ("TscClock, SyncMode",             ci, us, n_iter / 100 + 1);
+#endif
+
+  MPI_Finalize();
+  return 0;
+}
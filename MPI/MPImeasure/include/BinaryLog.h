@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// file format of BINARY_STAT (little endian, as written by the ranks):
+//   BinLogHeader | BinLogRecord[n_records] (grouped per flush, within a flush by rank) | region names ('\n' separated)
+//   (one name table for all ranks: ranks without header columns remap their region ids to it at every flush)
+// the header is rewritten by root at the end with n_records and the position of the region names
+struct BinLogHeader {
+  char magic[8];            // "MPIMEAS1"
+  uint32_t version;
+  uint32_t record_size;     // sizeof(BinLogRecord)
+  uint32_t n_ranks;
+  uint32_t n_regions;
+  uint64_t flags;           // DbgMeasureMode flagMask of the measurer
+  uint64_t n_records;
+  uint64_t names_offset, names_size;
+  uint32_t has_header;      // 1: regions are the header columns, 0: entries are written as name:value
+  uint32_t wtime_is_global;
+  double wtick;             // MPI_Wtick()
+  double wtime_start;       // MPI_Wtime() of root at setup
+};
+
+struct BinLogRecord {
+  int32_t rank;
+  int32_t region;           // -1: written without region
+  uint64_t line;            // number of newline()'s of the rank before the record
+  double time, wait;
+};
+
+static constexpr char BIN_LOG_MAGIC[8] = {'M', 'P', 'I', 'M', 'E', 'A', 'S', '1'};
+static constexpr uint32_t BIN_LOG_VERSION = 1;
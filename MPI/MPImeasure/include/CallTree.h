@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <mpi.h>
+
+// call tree of the nested measured regions (calls, inclusive and exclusive time per call path)
+// and a preallocated ring buffer of the most recent region events for the trace export
+struct CallTree {
+  using strvec = std::vector<std::string>;
+
+  struct Node {
+    int region, parent, first_child, next_sibling;
+    size_t calls;
+    double incl, excl;
+  };
+  struct Frame {
+    int node;
+    double start, child_time;
+  };
+  struct Event {
+    int node;
+    double start, end;
+  };
+
+  std::vector<Node> nodes;      // nodes[0]: virtual root
+  std::vector<Frame> frames;    // len: max_depth
+  std::vector<Event> events;    // ring buffer, len: capacity
+  size_t depth = 0, n_events = 0;
+  double t0 = 0.0;
+
+  CallTree(size_t capacity = 0, size_t max_depth = 64, double t0 = 0.0)
+      : frames(max_depth), events(capacity), t0{t0} {
+    nodes.push_back({-1, -1, -1, -1, 0, 0.0, 0.0});
+  }
+
+  int child(int parent, int region) {
+    int* link = &nodes[parent].first_child;
+    for (; *link != -1; link = &nodes[*link].next_sibling)
+      if (nodes[*link].region == region) return *link;
+    *link = nodes.size();
+    nodes.push_back({region, parent, -1, -1, 0, 0.0, 0.0});
+    return nodes.size() - 1;
+  }
+
+  void enter(int region, double now) {
+    if (depth == frames.size()) { fprintf(stderr, "ERROR: measured regions nested deeper than %lu\n", frames.size()); exit(1); }
+    int parent = (depth > 0) ? frames[depth - 1].node : 0;
+    frames[depth++] = {child(parent, region), now, 0.0};
+  }
+
+  void leave(double now) {
+    Frame& fr = frames[--depth];
+    Node& node = nodes[fr.node];
+    double incl = now - fr.start;
+    ++node.calls;
+    node.incl += incl;
+    node.excl += incl - fr.child_time;
+    if (depth > 0) frames[depth - 1].child_time += incl;
+    if (not events.empty()) events[n_events++ % events.size()] = {fr.node, fr.start, now};
+  }
+
+  std::string region_name(const Node& node, const strvec& names) const {
+    return (node.region >= 0 and node.region < static_cast<int>(names.size())) ? names[node.region] : "?";
+  }
+
+  std::string path(const std::vector<Node>& nodes, int node, const strvec& names, const char* delim) const {
+    if (node <= 0) return "";
+    std::string parent_path = path(nodes, nodes[node].parent, names, delim);
+    return (parent_path.empty() ? "" : parent_path + delim) + region_name(nodes[node], names);
+  }
+
+  // indented tree: [n:calls]  inclusive exclusive
+  void write_summary(FILE* fp, const strvec& names, int node = 0, int indent = 0) const {
+    if (not fp) return;
+    if (node == 0) fprintf(fp, "\n[tree]  [n:calls]  incl excl\n");
+    else fprintf(fp, "%*s%s  [n:%lu]  %f %f\n", 2 * indent, "", region_name(nodes[node], names).c_str(),
+                 nodes[node].calls, nodes[node].incl, nodes[node].excl);
+    for (int kid = nodes[node].first_child; kid != -1; kid = nodes[kid].next_sibling)
+      write_summary(fp, names, kid, indent + (node != 0));
+  }
+
+  // collective: root receives the trees and events rank by rank and writes
+  //   <fname_base>.trace.json (Chrome Trace Event format, one process per rank)
+  //   <fname_base>.folded     (collapsed stacks of exclusive time in us, e.g. for flamegraph.pl)
+  void export_trace(std::string fname_base, const strvec& names, int me, int root, int n_ranks, MPI_Comm comm) const {
+    size_t n_kept = std::min(n_events, events.size());
+    if (me != root) {
+      double info[3] = {static_cast<double>(nodes.size()), static_cast<double>(n_kept), t0};
+      MPI_Send(info, 3, MPI_DOUBLE, root, 0, comm);
+      MPI_Send(nodes.data(), nodes.size() * sizeof(Node), MPI_BYTE, root, 0, comm);
+      MPI_Send(events.data(), n_kept * sizeof(Event), MPI_BYTE, root, 0, comm);
+      return;
+    }
+    FILE* trace = fopen((fname_base + ".trace.json").c_str(), "w");
+    FILE* folded = fopen((fname_base + ".folded").c_str(), "w");
+    if (not trace or not folded) { fprintf(stderr, "ERROR: unable to open trace files '%s.*'\n", fname_base.c_str()); exit(1); }
+    fprintf(trace, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    std::vector<Node> rank_nodes;
+    std::vector<Event> rank_events;
+    for (int rank = 0; rank < n_ranks; ++rank) {
+      double rank_t0 = t0;
+      if (rank == root) {
+        rank_nodes = nodes;
+        rank_events.assign(events.begin(), events.begin() + n_kept);
+      } else {
+        double info[3];
+        MPI_Recv(info, 3, MPI_DOUBLE, rank, 0, comm, MPI_STATUS_IGNORE);
+        rank_nodes.resize(info[0]);
+        rank_events.resize(info[1]);
+        rank_t0 = info[2];
+        MPI_Recv(rank_nodes.data(), rank_nodes.size() * sizeof(Node), MPI_BYTE, rank, 0, comm, MPI_STATUS_IGNORE);
+        MPI_Recv(rank_events.data(), rank_events.size() * sizeof(Event), MPI_BYTE, rank, 0, comm, MPI_STATUS_IGNORE);
+      }
+
+      fprintf(trace, "%s{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %i, \"args\": {\"name\": \"rank %i\"}}",
+              first ? "" : ",\n", rank, rank);
+      first = false;
+      for (const Event& ev : rank_events)
+        fprintf(trace, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %i, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}",
+                region_name(rank_nodes[ev.node], names).c_str(), rank, (ev.start - rank_t0) * 1e6, (ev.end - ev.start) * 1e6);
+      for (size_t node = 1; node < rank_nodes.size(); ++node)
+        fprintf(folded, "rank%03i;%s %.0f\n", rank, path(rank_nodes, node, names, ";").c_str(), rank_nodes[node].excl * 1e6);
+    }
+    fprintf(trace, "\n]}\n");
+    fclose(trace);
+    fclose(folded);
+  }
+};
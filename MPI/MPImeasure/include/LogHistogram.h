@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+// log-bucketed histogram (HDR style) of durations in seconds, stored in a plain bucket array so that
+// histograms of several ranks can be merged with MPI_Reduce(MPI_UINT64_T, MPI_SUM)
+//   - constant memory (N_BUCKETS counters), O(1) record
+//   - ns resolution, relative bucket width <= 1/16, values up to 2^(MAX_BITS+1) ns (~36 min)
+struct LogHistogram {
+  static constexpr int SUB_BITS = 5;
+  static constexpr uint64_t SUB_HALF = 1ull << (SUB_BITS - 1);
+  static constexpr int MAX_BITS = 40;
+  static constexpr size_t N_BUCKETS = (MAX_BITS - SUB_BITS + 3) * SUB_HALF;
+
+  static size_t index(uint64_t ns) {
+    ns = std::min<uint64_t>(ns, (2ull << MAX_BITS) - 1);
+    if (ns < 2 * SUB_HALF) return ns;
+    int exp = (63 - __builtin_clzll(ns)) - (SUB_BITS - 1);
+    return exp * SUB_HALF + (ns >> exp);
+  }
+
+  // midpoint of the bucket in seconds
+  static double value(size_t idx) {
+    if (idx < 2 * SUB_HALF) return (idx + 0.5) * 1e-9;
+    int exp = idx / SUB_HALF - 1;
+    uint64_t low = (idx % SUB_HALF + SUB_HALF) << exp;
+    return (low + 0.5 * (1ull << exp)) * 1e-9;
+  }
+
+  static void record(uint64_t* buckets, double seconds) {
+    ++buckets[index(seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e9) : 0)];
+  }
+
+  static uint64_t count(const uint64_t* buckets) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < N_BUCKETS; ++i) n += buckets[i];
+    return n;
+  }
+
+  // q in [0,1]; NaN for an empty histogram
+  static double percentile(const uint64_t* buckets, double q) {
+    uint64_t n = count(buckets);
+    if (n == 0) return std::numeric_limits<double>::quiet_NaN();
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * n))), cumulated = 0;
+    for (size_t i = 0; i < N_BUCKETS; ++i)
+      if ((cumulated += buckets[i]) >= target) return value(i);
+    return value(N_BUCKETS - 1);
+  }
+};
@@ -2,15 +2,54 @@
 
 #include <algorithm>
 #include <vector>
-#include <stack>
+#include <deque>
 #include <map>
 #include <sstream>
 #include <iterator>
 #include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <cstdlib>
 #include <mpi.h>
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+#include "LogHistogram.h"
+#include "CallTree.h"
+#include "PerfCounters.h"
+#include "Timeline.h"
+#include "NodeReduce.h"
+#include "BinaryLog.h"
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
 
-// NOTE: Do not use RUNTIME and UNSYNCNESS at the same time!
-enum DbgMeasureMode { OFF=0, RUNTIME=1, UNSYNCNESS=2, ROOT_STAT=4, TOTAL_STAT=8, };
+// NOTE: RUNTIME and UNSYNCNESS at the same time measure the runtime and then the wait time at a barrier of each
+//       region (plus imbalance: max/avg runtime, % of time lost waiting); ROOT_STAT then implies BATCH_STAT
+// NOTE: BATCH_STAT implies ROOT_STAT; samples are buffered and reduced once per flush interval
+// NOTE: ASYNC_STAT implies ROOT_STAT; reductions are posted non-blocking and written lazily
+// NOTE: THREAD_STAT requires a header and RUNTIME; regions may be measured inside OpenMP parallel regions
+// NOTE: HIST_STAT writes percentiles of each region at the end (merged over all ranks with ROOT_STAT)
+// NOTE: TREE_STAT records the nesting of regions (master thread only): call tree in the log, trace files on root
+// NOTE: PERF_STAT counts hardware events per region (master thread only; events: $MPIMEASURE_PERF_EVENTS=a,b,..)
+//       and is disabled with a warning if perf_event_open is not permitted
+// NOTE: TIMELINE_STAT records start/end of each region (master thread), corrected for clock offset and drift
+//       against root (ping-pong at setup and teardown): merged <fname>.timeline and arrival skew per region on root
+// NOTE: NODE_STAT implies BATCH_STAT (except with THREAD_STAT, not with ASYNC_STAT); stats are combined per node
+//       through a shared memory window and reduced among the node leaders only; per-node summary at the end
+// NOTE: BINARY_STAT (without ROOT_STAT) writes the samples of all ranks as fixed-size records into a single file
+//       <fname of root>.bin, collectively every flush interval (default 1024 lines); only root opens a text log
+//       (header and end-of-run summaries); see tools/mpimeasure_bin2txt for the conversion to the per-rank logs
+enum DbgMeasureMode { OFF=0, RUNTIME=1, UNSYNCNESS=2, ROOT_STAT=4, TOTAL_STAT=8, BATCH_STAT=16, ASYNC_STAT=32, THREAD_STAT=64, HIST_STAT=128, TREE_STAT=256, PERF_STAT=512, TIMELINE_STAT=1024, NODE_STAT=2048, BINARY_STAT=4096, };
+
+#ifdef _OPENMP
+  static int thread_num()  { return omp_get_thread_num(); }
+  static int max_threads() { return omp_get_max_threads(); }
+#else
+  static int thread_num()  { return 0; }
+  static int max_threads() { return 1; }
+#endif
 
 static std::string join(std::vector<std::string> const &strings, std::string delim) {
     std::stringstream ss;
@@ -19,6 +58,14 @@ static std::string join(std::vector<std::string> const &strings, std::string del
     return ss.str();
 }
 
+static std::vector<std::string> split(std::string const &str, char delim) {
+    std::vector<std::string> res;
+    std::stringstream ss(str);
+    for (std::string item; std::getline(ss, item, delim); )
+      if (not item.empty()) res.push_back(item);
+    return res;
+}
+
 struct CommInfo {
   int me, root, n_ranks;
   MPI_Comm comm;
@@ -32,6 +79,41 @@ struct CommInfo {
 };
 
 
+// compact handle of a measured region: index into the header (or into the names registered so far)
+using RegionId = int;
+constexpr RegionId NO_REGION = -1;
+
+constexpr uint64_t fnv1a(const char* s) {
+  uint64_t hash = 14695981039346656037ull;
+  for (; *s; ++s) hash = (hash ^ static_cast<unsigned char>(*s)) * 1099511628211ull;
+  return hash;
+}
+
+// region name with its hash; computed at compile time for string literals (e.g. in DEBUG_MEASURE)
+struct RegionKey {
+  uint64_t hash;
+  const char* name;
+  constexpr RegionKey(const char* name) : hash{fnv1a(name)}, name{name} { }
+  RegionKey(const std::string& name) : RegionKey(name.c_str()) { }
+};
+
+
+// packed (min, sum, max) of one sample, so that all stats of a batch are reduced by a single MPI_Reduce
+struct MinSumMax {
+  double min, sum, max;
+
+  static void reduce(void* in, void* inout, int* len, MPI_Datatype*) {
+    MinSumMax* a = static_cast<MinSumMax*>(in);
+    MinSumMax* b = static_cast<MinSumMax*>(inout);
+    for (int i = 0; i < *len; ++i) {
+      b[i].min = std::min(a[i].min, b[i].min);
+      b[i].sum = a[i].sum + b[i].sum;
+      b[i].max = std::max(a[i].max, b[i].max);
+    }
+  }
+};
+
+
 struct TimeMeasurer {
   using strvec = std::vector<std::string>;
 
@@ -40,20 +122,140 @@ struct TimeMeasurer {
   CommInfo ci;
 
   strvec header;
-  bool root_stat, total_stat;
+  bool root_stat, total_stat, batch_stat, async_stat, thread_stat, hist_stat, tree_stat, perf_stat, timeline_stat, node_stat, binary_stat, wait_mode;
+
+  // region registry: names (= header if given) and an open addressing table hash -> RegionId
+  strvec regions;
+  std::vector<std::pair<uint64_t, RegionId>> region_table;
+  std::string na_str;
 
   enum StatKind { MIN, AVG, MAX, SUM };
-  std::stack<double> start_times;
   double diff_time, time_stat[3];
-  std::vector<double[4][3]> total_time_stat;
+  double wait_time = 0.0, wait_stat[3];   // combined RUNTIME|UNSYNCNESS: wait time at the barrier after the region
+  std::vector<double[4][3]> total_time_stat, total_wait_stat;
   std::vector<size_t> n_timesteps;
   size_t col_cnt;
-  
+
+  // batch/async mode: samples and output events buffered until their stats have been reduced to root
+  struct BatchEvent {
+    enum Kind { SAMPLE, WRITE, EOL } kind;
+    RegionId region;
+  };
+  std::vector<MinSumMax> batch_samples;
+  std::deque<MinSumMax> batch_stats;    // reduced on root, not yet replayed
+  std::deque<BatchEvent> batch_events;
+  size_t flush_interval = 1, n_batched_lines = 0;
+  MPI_Datatype mpi_minsummax = MPI_DATATYPE_NULL;
+  MPI_Op mpi_minsummax_op = MPI_OP_NULL;
+
+  // async mode: ring of posted MPI_Ireduce's on a duplicated communicator (oldest is waited for if full)
+  struct PendingReduce {
+    std::vector<MinSumMax> send, recv;
+    MPI_Request req = MPI_REQUEST_NULL;
+  };
+  std::vector<PendingReduce> async_ring;
+  size_t async_head = 0, async_cnt = 0;
+  MPI_Comm async_comm = MPI_COMM_NULL;
+
+  // thread mode: time per region and thread of the current line, the slots of a thread in cache lines of its own
+  struct ThreadSample {
+    double time;
+    size_t n;
+  };
+  static constexpr size_t SAMPLES_PER_LINE = 64 / sizeof(ThreadSample);
+  struct alignas(64) ThreadSampleLine {
+    ThreadSample slots[SAMPLES_PER_LINE];
+  };
+  std::vector<ThreadSampleLine> thread_samples;   // len: n_threads * thread_stride
+  std::vector<MinSumMax> thread_stats, thread_stats_red;
+  size_t n_threads = 1, thread_stride = 0;        // cache lines per thread
+  ThreadSample& thread_sample(size_t thread, size_t region) {
+    return thread_samples[thread * thread_stride + region / SAMPLES_PER_LINE].slots[region % SAMPLES_PER_LINE];
+  }
+
+  // hist mode: local histogram of the samples of each region (len: regions * LogHistogram::N_BUCKETS)
+  std::vector<uint64_t> hist;
+
+  // tree mode: call tree and event ring buffer, exported to <fname>.trace.json and <fname>.folded
+  std::string fname;
+  CallTree tree;
+
+  // perf mode: counter values at enter() (stack) and summed counts and time per region
+  PerfCounters perf;
+  std::vector<uint64_t> perf_stack;   // len: 64 * PerfCounters::MAX_EVENTS
+  std::vector<double> perf_start_times;
+  std::vector<uint8_t> perf_started;  // per depth: counters read at the start
+  size_t perf_depth = 0, perf_skipped = 0;
+  std::vector<uint64_t> perf_counts;  // len: regions * PerfCounters::MAX_EVENTS
+  std::vector<double> perf_times;
+  std::vector<size_t> perf_calls;
+
+  // timeline mode: corrected start/end of every region, exported to <fname>.timeline
+  Timeline timeline;
+
+  // node mode: two-level reduction of the MinSumMax stats and the summed time per region of this rank
+  NodeReduce<MinSumMax> node;
+  std::vector<double> node_time;
+
+  // binary mode: records of this rank since the last collective write to the shared file
+  MPI_File bin_file = MPI_FILE_NULL;
+  BinLogHeader bin_header;
+  std::vector<BinLogRecord> bin_records;
+  uint64_t bin_offset = 0, bin_line = 0;
+  // without header: region id of this rank -> id of the name table common to all ranks (bin_names)
+  std::vector<int32_t> bin_region_ids;
+  strvec bin_names;
+  std::map<std::string, int32_t> bin_name_ids;
+
+  // sampling: only every sample_stride-th invocation of a region is measured (see set_sampling())
+  bool sampling = false, line_written = false;
+  size_t sample_stride = 1, min_sample_stride = 1;
+  std::vector<size_t> n_calls, next_sample;   // per region
+  double overhead_target = 0.0;               // adaptive if > 0: max. fraction of the step time spent measuring
+  double overhead_time = 0.0, timer_cost = 0.0, adapt_start_time = 0.0;
+  size_t adapt_interval = 16, n_adapt_lines = 0;
+
   TimeMeasurer(std::string fname, size_t flagMask, strvec header, MPI_Comm comm = MPI_COMM_WORLD)
-      : flagMask{flagMask}, header{header}, ci{CommInfo::getDefault(comm)} {
+      : TimeMeasurer(fname, flagMask, header, CommInfo::getDefault(comm)) { }
+  TimeMeasurer(std::string fname, size_t flagMask, strvec header, CommInfo ci)
+      : flagMask{flagMask}, ci{ci}, header{header}, fname{fname} {
     total_stat = flagMask & DbgMeasureMode::TOTAL_STAT;
-    root_stat = (flagMask & DbgMeasureMode::ROOT_STAT) or total_stat;
+    batch_stat = flagMask & DbgMeasureMode::BATCH_STAT;
+    async_stat = flagMask & DbgMeasureMode::ASYNC_STAT;
+    thread_stat = flagMask & DbgMeasureMode::THREAD_STAT;
+    hist_stat = flagMask & DbgMeasureMode::HIST_STAT;
+    tree_stat = flagMask & DbgMeasureMode::TREE_STAT;
+    if (tree_stat) tree = CallTree(1 << 16, 64, MPI_Wtime());
+    perf_stat = flagMask & DbgMeasureMode::PERF_STAT;
+    if (perf_stat) {
+      const char* env = getenv("MPIMEASURE_PERF_EVENTS");
+      set_perf_events(env ? split(env, ',') : PerfCounters::default_events());
+    }
+    timeline_stat = flagMask & DbgMeasureMode::TIMELINE_STAT;
+    if (timeline_stat) {
+      timeline = Timeline(1 << 20);
+      timeline.sync.start(ci.root, ci.me, ci.n_ranks, ci.comm);
+    }
+    node_stat = flagMask & DbgMeasureMode::NODE_STAT;
+    if (node_stat and async_stat) { fprintf(stderr, "ERROR: incompatible: node_stat with async_stat\n"); exit(1); }
+    if (node_stat and not thread_stat) batch_stat = true;
+    root_stat = (flagMask & DbgMeasureMode::ROOT_STAT) or total_stat or batch_stat or async_stat or node_stat;
+    wait_mode = (flagMask & DbgMeasureMode::RUNTIME) and (flagMask & DbgMeasureMode::UNSYNCNESS);
+    if (wait_mode and root_stat and not async_stat) batch_stat = true;   // keep the barrier the only collective per region
     if (header.empty() and total_stat) { fprintf(stderr, "ERROR: incompatible: total_stat without header given\n"); exit(1); }
+    if (header.empty() and thread_stat) { fprintf(stderr, "ERROR: incompatible: thread_stat without header given\n"); exit(1); }
+    binary_stat = flagMask & DbgMeasureMode::BINARY_STAT;
+    if (binary_stat and (root_stat or thread_stat)) {
+      fprintf(stderr, "ERROR: incompatible: binary_stat with root_stat or thread_stat\n"); exit(1);
+    }
+    if (thread_stat and (buffered() or wait_mode or (flagMask & DbgMeasureMode::UNSYNCNESS))) {
+      fprintf(stderr, "ERROR: incompatible: thread_stat with batch_stat, async_stat or unsyncness\n"); exit(1);
+    }
+    if (thread_stat) {
+      n_threads = max_threads();
+      thread_stride = (header.size() + SAMPLES_PER_LINE - 1) / SAMPLES_PER_LINE;
+      thread_samples = std::vector<ThreadSampleLine>(n_threads * thread_stride, ThreadSampleLine{});
+    }
     if (total_stat) {
       total_time_stat = std::vector<double[4][3]>(header.size());
       for (size_t comp = 0; comp < total_time_stat.size(); ++comp)
@@ -61,37 +263,97 @@ struct TimeMeasurer {
           for (size_t col = StatKind::MIN; col <= StatKind::MAX; ++col)
             total_time_stat[comp][row][col] = (row == StatKind::MIN) ? 1.0 : 0.0;
       n_timesteps = std::vector<size_t>(header.size(), 0);
+      if (wait_mode) {
+        total_wait_stat = std::vector<double[4][3]>(header.size());
+        for (size_t comp = 0; comp < total_wait_stat.size(); ++comp)
+          for (size_t row = StatKind::MIN; row <= StatKind::SUM; ++row)
+            for (size_t col = StatKind::MIN; col <= StatKind::MAX; ++col)
+              total_wait_stat[comp][row][col] = (row == StatKind::MIN) ? 1.0 : 0.0;
+      }
     }
-    if ((not root_stat) or ci.i_am_root()) {
+    if ((not root_stat and not binary_stat) or ci.i_am_root()) {
       fp = fopen(fname.c_str(), "w");
       fprintf(fp, "%s\n", join(header, " ").c_str());
     }
     col_cnt = 0;
-  }
-  TimeMeasurer(std::string fname, size_t flagMask, strvec header, CommInfo ci)
-      : TimeMeasurer(fname, flagMask, header) {
-    ci = ci;
+    na_str = root_stat ? "(   NA       NA       NA   )  " : "   NA   ";
+    if (wait_mode) na_str = root_stat ? "(   NA       NA       NA   )<   NA       NA       NA   >[   NA      NA   ]  " : "   NA   (+   NA   ) ";
+    if (thread_stat) na_str = root_stat ? "(   NA       NA       NA   )[   NA       NA       NA   ]  " : "[   NA       NA       NA   ]  ";
+    for (const std::string& name : header) register_region(name.c_str());
+    if (uses_minsummax()) {
+      MPI_Type_contiguous(3, MPI_DOUBLE, &mpi_minsummax);
+      MPI_Type_commit(&mpi_minsummax);
+      MPI_Op_create(&MinSumMax::reduce, true, &mpi_minsummax_op);
+    }
+    if (node_stat) node.init(ci.comm, ci.root);
+    if (binary_stat) open_binary();
+    if (async_stat) {
+      MPI_Comm_dup(ci.comm, &async_comm);
+      async_ring.resize(64);
+    }
   }
 
   virtual ~TimeMeasurer() {
+    if (uses_minsummax()) {
+      collect_batch();
+      complete_async(true);
+      if (hist_stat) write_percentiles();
+      if (perf_stat) write_perf();
+      if (node_stat) {
+        write_nodes();
+        node.free();
+      }
+      MPI_Op_free(&mpi_minsummax_op);
+      MPI_Type_free(&mpi_minsummax);
+    }
+    if (async_stat) MPI_Comm_free(&async_comm);
+    if (binary_stat) close_binary();
+    if (timeline_stat) {
+      timeline.sync.stop(ci.root, ci.me, ci.n_ranks, ci.comm);
+      timeline.export_timeline(fname, regions, ci.i_am_root() ? fp : nullptr, ci.me, ci.root, ci.n_ranks, ci.comm);
+    }
+    if (tree_stat) {
+      tree.write_summary(fp, regions);
+      tree.export_trace(fname, regions, ci.me, ci.root, ci.n_ranks, ci.comm);
+    }
     if (fp) {
       if (total_stat and ci.i_am_root()) {
-        newline();
+        eol();
 
+        if (sampling) fprintf(fp, "sampled: [n:measured/calls], sums extrapolated by calls/measured\n");
         for (size_t comp = 0; comp < total_time_stat.size(); ++comp) {
-          fprintf(fp, "[n:%lu]  ", n_timesteps[comp]);
+          if (sampling) fprintf(fp, "[n:%lu/%lu]  ", n_timesteps[comp], comp < n_calls.size() ? n_calls[comp] : 0);
+          else          fprintf(fp, "[n:%lu]  ", n_timesteps[comp]);
           for (size_t col = StatKind::MIN; col <= StatKind::MAX; ++col)
             total_time_stat[comp][StatKind::AVG][col] = total_time_stat[comp][StatKind::SUM][col] / n_timesteps[comp];
-        } newline();
+          if (sampling and n_timesteps[comp] > 0) {
+            double scale = 1.0 * n_calls[comp] / n_timesteps[comp];
+            for (size_t col = StatKind::MIN; col <= StatKind::MAX; ++col) {
+              total_time_stat[comp][StatKind::SUM][col] *= scale;
+              if (wait_mode) total_wait_stat[comp][StatKind::SUM][col] *= scale;
+            }
+          }
+        } eol();
 
         for (size_t comp = 0; comp < total_time_stat.size(); ++comp) {
           printStat(total_time_stat[comp][StatKind::SUM], '[', ']');
-        } newline();
+        } eol();
 
         for (size_t row = StatKind::MIN; row <= StatKind::MAX; ++row) {
           for (size_t comp = 0; comp < total_time_stat.size(); ++comp) {
             printStat(total_time_stat[comp][row], '[', ']');
-          } newline();
+          } eol();
+        }
+
+        if (wait_mode) {    // summed wait times and imbalance over all timesteps
+          for (size_t comp = 0; comp < total_wait_stat.size(); ++comp) {
+            printStat(total_wait_stat[comp][StatKind::SUM], '<', '>');
+          } eol();
+          for (size_t comp = 0; comp < total_wait_stat.size(); ++comp) {
+            double (&rt)[3] = total_time_stat[comp][StatKind::SUM];
+            double (&wt)[3] = total_wait_stat[comp][StatKind::SUM];
+            printImbalance(rt, wt);
+          } eol();
         }
       }
       fclose(fp);
@@ -100,90 +362,726 @@ struct TimeMeasurer {
   }
 
   virtual void before() =0;
-  virtual void after(std::string prefix) =0;
+  virtual void after(RegionId region) =0;
+  void after(RegionKey prefix) { after(region(prefix)); }
+
+  // tree/perf/timeline mode: called around the measured code block (only the master thread is recorded)
+  void enter(RegionId region) {
+    if (not (tree_stat or perf_stat or timeline_stat) or thread_num() != 0) return;
+    if (timeline_stat) timeline.enter(region, MPI_Wtime());
+    if (tree_stat) tree.enter(region, MPI_Wtime());
+    if (perf_stat) perf_enter();
+  }
+  void leave(RegionId region) {
+    if (not (tree_stat or perf_stat or timeline_stat) or thread_num() != 0) return;
+    if (perf_stat) perf_leave(region);
+    if (tree_stat) tree.leave(MPI_Wtime());
+    if (timeline_stat) timeline.leave(MPI_Wtime());
+  }
+  void set_trace_capacity(size_t n) { if (tree_stat) tree = CallTree(n, 64, MPI_Wtime()); }
+  void set_timeline_capacity(size_t n) { timeline.capacity = n; }
+
+  // collective: (re)opens the counter group with the events that could be opened on all ranks
+  void set_perf_events(const strvec& events) {
+    std::string error;
+    unsigned mask = 0;
+    perf = PerfCounters(events);
+    for (size_t i = 0; i < events.size(); ++i) if (perf.index(events[i]) != -1) mask |= 1u << i;
+    unsigned common_mask;
+    MPI_Allreduce(&mask, &common_mask, 1, MPI_UNSIGNED, MPI_BAND, ci.comm);
+    if (common_mask != mask) {
+      strvec common;
+      for (size_t i = 0; i < events.size(); ++i) if (common_mask & (1u << i)) common.push_back(events[i]);
+      error = perf.error.empty() ? "not available on all ranks" : perf.error;
+      perf = PerfCounters(common);
+    }
+    if (not perf.error.empty()) error = perf.error;
+    if (ci.i_am_root() and not error.empty())
+      fprintf(stderr, "WARNING: perf counters: %s -> measuring: %s\n", error.c_str(), perf.size() ? join(perf.names, " ").c_str() : "-");
+    perf_stat = perf.size() > 0;
+    perf_stack.assign(64 * PerfCounters::MAX_EVENTS, 0);
+    perf_start_times.assign(64, 0.0);
+    perf_started.assign(64, 0);
+    perf_depth = 0;
+  }
+
+  void perf_enter() {
+    if (perf_depth == perf_start_times.size()) { fprintf(stderr, "ERROR: measured regions nested deeper than %lu\n", perf_start_times.size()); exit(1); }
+    perf_started[perf_depth] = perf.read(&perf_stack[perf_depth * PerfCounters::MAX_EVENTS]);
+    perf_start_times[perf_depth++] = MPI_Wtime();
+  }
+
+  // a sample whose counters could not be read at its start or end is skipped (counted in perf_skipped)
+  void perf_leave(RegionId region) {
+    uint64_t values[PerfCounters::MAX_EVENTS];
+    double now = MPI_Wtime();
+    bool read = perf.read(values);
+    --perf_depth;
+    if (region == NO_REGION) return;
+    if (not read or not perf_started[perf_depth]) { ++perf_skipped; return; }
+    if (perf_calls.size() < regions.size()) {
+      perf_counts.resize(regions.size() * PerfCounters::MAX_EVENTS, 0);
+      perf_times.resize(regions.size(), 0.0);
+      perf_calls.resize(regions.size(), 0);
+    }
+    for (size_t ev = 0; ev < perf.size(); ++ev)
+      perf_counts[region * PerfCounters::MAX_EVENTS + ev] += values[ev] - perf_stack[perf_depth * PerfCounters::MAX_EVENTS + ev];
+    perf_times[region] += now - perf_start_times[perf_depth];
+    ++perf_calls[region];
+  }
+
+  // perf mode: per region time per call, IPC and the other events per 1000 instructions (or per call without
+  // instructions); with root_stat (min avg max) over the ranks
+  void write_perf() {
+    const double inf = std::numeric_limits<double>::infinity();
+    const size_t n_reg = regions.size(), nev = PerfCounters::MAX_EVENTS;
+    int cyc = perf.index("cycles"), ins = perf.index("instructions");
+    strvec metrics = {"time/call"};
+    if (cyc != -1 and ins != -1) metrics.push_back("ipc");
+    for (size_t ev = 0; ev < perf.size(); ++ev) {
+      if ((int)ev == ins or ((int)ev == cyc and ins != -1)) continue;
+      metrics.push_back(perf.names[ev] + (ins != -1 ? "/ki" : "/call"));
+    }
+    const size_t n_met = metrics.size();
+    if (perf_skipped) fprintf(stderr, "WARNING: perf counters: rank %d: %zu samples skipped (counters not readable)\n", ci.me, perf_skipped);
+    perf_counts.resize(n_reg * nev, 0);
+    perf_times.resize(n_reg, 0.0);
+    perf_calls.resize(n_reg, 0);
+
+    std::vector<MinSumMax> vals(n_reg * (n_met + 1), {inf, 0.0, -inf}), vals_red;
+    for (size_t reg = 0; reg < n_reg; ++reg) {
+      if (perf_calls[reg] == 0) continue;
+      const uint64_t* cnt = &perf_counts[reg * nev];
+      std::vector<double> met = {perf_times[reg] / perf_calls[reg]};
+      if (cyc != -1 and ins != -1) met.push_back(cnt[cyc] ? 1.0 * cnt[ins] / cnt[cyc] : 0.0);
+      for (size_t ev = 0; ev < perf.size(); ++ev) {
+        if ((int)ev == ins or ((int)ev == cyc and ins != -1)) continue;
+        met.push_back(ins != -1 ? (cnt[ins] ? 1000.0 * cnt[ev] / cnt[ins] : 0.0) : 1.0 * cnt[ev] / perf_calls[reg]);
+      }
+      for (size_t m = 0; m < n_met; ++m) vals[reg * (n_met + 1) + m] = {met[m], met[m], met[m]};
+      vals[reg * (n_met + 1) + n_met] = {1.0, 1.0, 1.0};   // number of ranks with samples
+    }
+    if (root_stat) {
+      vals_red.resize(ci.i_am_root() ? vals.size() : 0);
+      reduce_minsummax(vals.data(), vals_red.data(), vals.size());
+    } else {
+      vals_red = vals;
+    }
+    if (not fp) return;
+
+    fprintf(fp, "\n[perf]  %s\n", join(metrics, " ").c_str());
+    for (size_t reg = 0; reg < n_reg; ++reg) {
+      double n = vals_red[reg * (n_met + 1) + n_met].sum;
+      if (n == 0) continue;
+      fprintf(fp, "%s:  ", regions[reg].c_str());
+      for (size_t m = 0; m < n_met; ++m) {
+        MinSumMax& v = vals_red[reg * (n_met + 1) + m];
+        if (root_stat) fprintf(fp, "(%f %f %f)  ", v.min, v.sum / n, v.max);
+        else           fprintf(fp, "%f  ", v.min);
+      }
+      eol();
+    }
+  }
+
+  // called by after() with the measured time of the region
+  void sample(RegionId region, double time, double wait = 0.0) {
+    double t0 = sampling ? MPI_Wtime() : 0.0;
+    diff_time = time;
+    wait_time = wait;
+    if (hist_stat) record_hist(region, time);
+    if (node_stat and region != NO_REGION) {
+      if (static_cast<size_t>(region) >= node_time.size()) node_time.resize(regions.size(), 0.0);
+      node_time[region] += time;
+    }
+    if (root_stat) collect(region);
+    if (sampling) overhead_time += MPI_Wtime() - t0 + timer_cost;
+  }
+
+  // sampling: true if this invocation of the region is measured (same decision on all ranks)
+  bool sampled(RegionId region) {
+    if (not sampling or region == NO_REGION) return true;
+    if (static_cast<size_t>(region) >= n_calls.size()) {
+      n_calls.resize(regions.size(), 0);
+      next_sample.resize(regions.size(), 0);
+    }
+    if (n_calls[region]++ != next_sample[region]) return false;
+    next_sample[region] += sample_stride;
+    return true;
+  }
+
+  // measure every n-th invocation of each region; max_overhead > 0: the stride is adapted (n is its minimum) every
+  // adapt_interval lines such that the time spent measuring stays below max_overhead percent of the time between lines
+  // NOTE: collective with ROOT_STAT or UNSYNCNESS (the stride is agreed on with an allreduce, so the barriers of
+  //       the measured invocations match on all ranks); not with THREAD_STAT
+  void set_sampling(size_t n, double max_overhead = 0.0) {
+    if (thread_stat) { fprintf(stderr, "ERROR: incompatible: sampling with thread_stat\n"); exit(1); }
+    min_sample_stride = sample_stride = std::max<size_t>(n, 1);
+    overhead_target = max_overhead / 100.0;
+    sampling = sample_stride > 1 or overhead_target > 0.0;
+    double t0 = MPI_Wtime();   // cost of the two clock calls around a region
+    for (int i = 0; i < 1000; ++i) timer_cost += MPI_Wtime();
+    timer_cost = 2.0 * (MPI_Wtime() - t0) / 1000.0;
+    adapt_start_time = MPI_Wtime();
+    overhead_time = 0.0;
+    n_adapt_lines = 0;
+  }
+
+  void adapt_sampling() {
+    if (overhead_target <= 0.0 or ++n_adapt_lines < adapt_interval) return;
+    double now = MPI_Wtime();
+    double overhead = overhead_time / std::max(now - adapt_start_time, 1e-9);
+    if (root_stat or (flagMask & DbgMeasureMode::UNSYNCNESS))
+      MPI_Allreduce(MPI_IN_PLACE, &overhead, 1, MPI_DOUBLE, MPI_MAX, ci.comm);
+    if (overhead > overhead_target) sample_stride *= 2;
+    else if (overhead < overhead_target / 4) sample_stride = std::max(sample_stride / 2, min_sample_stride);
+    overhead_time = 0.0;
+    adapt_start_time = now;
+    n_adapt_lines = 0;
+  }
 
   double get() {
     return diff_time;
   }
 
-  void write(std::string prefix) {
-    if (not fp) return;
+  // region lookup: O(1) probe of the hash table, new names are only accepted if no header was given
+  RegionId region(RegionId id) { return id; }
+  RegionId region(RegionKey key) {
+    if (key.name[0] == '\0') return NO_REGION;
+    if (not region_table.empty()) {
+      for (size_t i = key.hash & (region_table.size() - 1); region_table[i].second != NO_REGION; i = (i + 1) & (region_table.size() - 1))
+        if (region_table[i].first == key.hash) return region_table[i].second;
+    }
+    if (not header.empty()) { fprintf(stderr, "ERROR: invalid prefix: '%s'\n", key.name); exit(1); }
+    return register_region(key);
+  }
+
+  RegionId register_region(RegionKey key) {
+    for (const std::string& name : regions)
+      if (fnv1a(name.c_str()) == key.hash) { fprintf(stderr, "ERROR: duplicate or colliding region name: '%s'\n", key.name); exit(1); }
+    regions.push_back(key.name);
+    if (2 * regions.size() > region_table.size()) {   // grow (power of two) to keep the load factor <= 1/2
+      size_t table_size = 16;
+      while (table_size < 4 * regions.size()) table_size *= 2;
+      region_table.assign(table_size, {0, NO_REGION});
+      for (RegionId id = 0; id < static_cast<RegionId>(regions.size()); ++id) insert_region(fnv1a(regions[id].c_str()), id);
+    } else {
+      insert_region(key.hash, regions.size() - 1);
+    }
+    return regions.size() - 1;
+  }
+
+  void insert_region(uint64_t hash, RegionId id) {
+    size_t i = hash & (region_table.size() - 1);
+    while (region_table[i].second != NO_REGION) i = (i + 1) & (region_table.size() - 1);
+    region_table[i] = {hash, id};
+  }
+
+  void write(RegionKey prefix) { write(region(prefix)); }
+  void write(RegionId region) {
+    if (binary_stat) {
+      bin_records.push_back({ci.me, region, bin_line, diff_time, wait_time});
+      return;
+    }
+    if (not fp or thread_stat) return;
+    line_written = true;
+    if (buffered()) { batch_events.push_back({BatchEvent::WRITE, region}); return; }
+    write_entry(region);
+  }
+
+  void write_entry(RegionId region) {
     if (header.empty()) {   // no header -> print name and value
-      if (prefix != "") print(prefix + ":");
-    } else {                // header -> pad if neccessary, then only print value
-      std::string na = "   NA   ";
-      if (root_stat) na = "(" + na + " " + na + " " + na + ")  ";
-      while (prefix != "" and prefix != header.at(col_cnt++)) print(na);
+      if (region != NO_REGION) { print(regions[region]); print(":"); }
+    } else if (region != NO_REGION) {   // header -> pad if neccessary, then only print value
+      for (; col_cnt < static_cast<size_t>(region); ++col_cnt) print(na_str);
+      ++col_cnt;
+    }
+    if (wait_mode) {
+      if (root_stat) {
+        fprintf(fp, "(%f %f %f)", time_stat[0], time_stat[1], time_stat[2]);
+        printStat(wait_stat, '<', '>');
+        printImbalance(time_stat, wait_stat);
+      } else {
+        fprintf(fp, "%f(+%f) ", diff_time, wait_time);
+      }
     }
-    if (root_stat) printStat(time_stat);
+    else if (root_stat) printStat(time_stat);
     else printDbl(diff_time);
   }
 
-  void collect(std::string prefix) {
+  void collect(RegionId region) {
+    if (buffered()) {
+      batch_samples.push_back({diff_time, diff_time, diff_time});
+      if (wait_mode) batch_samples.push_back({wait_time, wait_time, wait_time});
+      if (ci.i_am_root()) batch_events.push_back({BatchEvent::SAMPLE, region});
+      if (not batch_stat) post_async();
+      return;
+    }
     MPI_Reduce(&diff_time, &time_stat[StatKind::MIN], 1, MPI_DOUBLE, MPI_MIN, ci.root, ci.comm);
     MPI_Reduce(&diff_time, &time_stat[StatKind::AVG], 1, MPI_DOUBLE, MPI_SUM, ci.root, ci.comm);
     MPI_Reduce(&diff_time, &time_stat[StatKind::MAX], 1, MPI_DOUBLE, MPI_MAX, ci.root, ci.comm);
     time_stat[StatKind::AVG] /= ci.n_ranks;
+    accumulate(region);
+  }
+
+  void accumulate(RegionId comp) {
     if (total_stat and ci.i_am_root()) {
-      // DONE?: make it work
-      int comp = index_in_header(prefix);
-      if (comp == -1) { fprintf(stderr, "ERROR: invalid prefix: '%s'\n", prefix.c_str()); exit(1); }
+      if (comp == NO_REGION) { fprintf(stderr, "ERROR: total_stat requires a region prefix\n"); exit(1); }
       for (size_t col = StatKind::MIN; col <= StatKind::MAX; ++col) {
         total_time_stat[comp][StatKind::MIN][col] = std::min(total_time_stat[comp][StatKind::MIN][col], time_stat[col]);
         total_time_stat[comp][StatKind::MAX][col] = std::max(total_time_stat[comp][StatKind::MAX][col], time_stat[col]);
         total_time_stat[comp][StatKind::SUM][col] += time_stat[col];
+        if (not wait_mode) continue;
+        total_wait_stat[comp][StatKind::MIN][col] = std::min(total_wait_stat[comp][StatKind::MIN][col], wait_stat[col]);
+        total_wait_stat[comp][StatKind::MAX][col] = std::max(total_wait_stat[comp][StatKind::MAX][col], wait_stat[col]);
+        total_wait_stat[comp][StatKind::SUM][col] += wait_stat[col];
       }
       ++n_timesteps[comp];
     }
   }
 
-  void print(std::string str)     { if (fp) fprintf(fp, "%s", str.c_str()); }
+  // reduce all buffered samples at once (collective), blocking or posted to the async ring
+  void collect_batch() {
+    n_batched_lines = 0;
+    if (async_stat) { post_async(); return; }
+    if (not batch_samples.empty()) {
+      std::vector<MinSumMax> stats(ci.i_am_root() ? batch_samples.size() : 0);
+      reduce_minsummax(batch_samples.data(), stats.data(), batch_samples.size());
+      batch_stats.insert(batch_stats.end(), stats.begin(), stats.end());
+      batch_samples.clear();
+    }
+    replay();
+  }
+
+  // collective: flat MPI_Reduce to root, or node-aware in node mode
+  void reduce_minsummax(const MinSumMax* send, MinSumMax* recv, size_t n) {
+    if (node_stat) node.reduce(send, recv, n, mpi_minsummax, mpi_minsummax_op);
+    else           MPI_Reduce(send, recv, n, mpi_minsummax, mpi_minsummax_op, ci.root, ci.comm);
+  }
+
+  // collective: (min avg max) over the ranks of each node of the summed time per region, one line per node on root
+  void write_nodes() {
+    const size_t n_reg = regions.size();
+    node_time.resize(n_reg, 0.0);
+    std::vector<MinSumMax> vals(n_reg + 1), node_vals(node.leader() ? n_reg + 1 : 0), all_vals;
+    for (size_t reg = 0; reg < n_reg; ++reg) vals[reg] = {node_time[reg], node_time[reg], node_time[reg]};
+    vals[n_reg] = {1.0, 1.0, 1.0};   // number of ranks of the node
+    node.reduce_node(vals.data(), node_vals.data(), vals.size(), mpi_minsummax);
+    if (not node.leader()) return;
+
+    char host[MPI_MAX_PROCESSOR_NAME] = {0};
+    int len;
+    MPI_Get_processor_name(host, &len);
+    std::vector<char> hosts(ci.i_am_root() ? node.n_nodes * MPI_MAX_PROCESSOR_NAME : 0);
+    all_vals.resize(ci.i_am_root() ? node.n_nodes * vals.size() : 0);
+    MPI_Gather(node_vals.data(), vals.size(), mpi_minsummax, all_vals.data(), vals.size(), mpi_minsummax, 0, node.leader_comm);
+    MPI_Gather(host, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, hosts.data(), MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, node.leader_comm);
+    if (not fp or not ci.i_am_root()) return;
+
+    fprintf(fp, "\n[node]  %s\n", join(regions, " ").c_str());
+    for (int nd = 0; nd < node.n_nodes; ++nd) {
+      MinSumMax* nv = &all_vals[nd * vals.size()];
+      fprintf(fp, "%s  [n:%.0f]  ", &hosts[nd * MPI_MAX_PROCESSOR_NAME], nv[n_reg].sum);
+      for (size_t reg = 0; reg < n_reg; ++reg) {
+        double stat[3] = {nv[reg].min, nv[reg].sum / nv[n_reg].sum, nv[reg].max};
+        printStat(stat);
+      }
+      eol();
+    }
+  }
+
+  // collective: all ranks open <fname of root>.bin, root writes a preliminary header
+  void open_binary() {
+    int len = fname.size();
+    MPI_Bcast(&len, 1, MPI_INT, ci.root, ci.comm);
+    std::string bin_fname = fname;
+    bin_fname.resize(len);
+    MPI_Bcast(&bin_fname[0], len, MPI_CHAR, ci.root, ci.comm);
+    bin_fname += ".bin";
+    if (ci.i_am_root()) MPI_File_delete(bin_fname.c_str(), MPI_INFO_NULL);
+    MPI_Barrier(ci.comm);
+    if (MPI_File_open(ci.comm, bin_fname.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &bin_file) != MPI_SUCCESS) {
+      fprintf(stderr, "ERROR: unable to open binary log '%s'\n", bin_fname.c_str()); exit(1);
+    }
+    int is_global = 0, flag = 0;
+    int* attr;
+    MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_WTIME_IS_GLOBAL, &attr, &flag);
+    if (flag) is_global = *attr;
+    bin_header = {{}, BIN_LOG_VERSION, sizeof(BinLogRecord), static_cast<uint32_t>(ci.n_ranks), 0, flagMask, 0, 0, 0,
+                  not header.empty(), static_cast<uint32_t>(is_global), MPI_Wtick(), MPI_Wtime()};
+    std::copy(BIN_LOG_MAGIC, BIN_LOG_MAGIC + 8, bin_header.magic);
+    MPI_Bcast(&bin_header.wtime_start, 1, MPI_DOUBLE, ci.root, ci.comm);
+    if (ci.i_am_root()) MPI_File_write_at(bin_file, 0, &bin_header, sizeof(bin_header), MPI_BYTE, MPI_STATUS_IGNORE);
+    bin_offset = sizeof(BinLogHeader);
+    flush_interval = 1024;
+  }
+
+  // collective: without header every rank numbers its regions in the order of their first use, so the names
+  // registered since the last call are gathered (in rank order) into a common name table and the records remapped
+  void sync_binary_regions() {
+    if (not header.empty()) return;
+    std::string new_names;
+    for (size_t id = bin_region_ids.size(); id < regions.size(); ++id) new_names += regions[id] + '\n';
+    int len = new_names.size();
+    std::vector<int> lens(ci.n_ranks), displs(ci.n_ranks, 0);
+    MPI_Allgather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, ci.comm);
+    for (int r = 1; r < ci.n_ranks; ++r) displs[r] = displs[r-1] + lens[r-1];
+    if (displs.back() + lens.back() > 0) {
+      std::string all(displs.back() + lens.back(), '\0');
+      MPI_Allgatherv(new_names.data(), len, MPI_CHAR, &all[0], lens.data(), displs.data(), MPI_CHAR, ci.comm);
+      for (size_t pos = 0, end; pos < all.size(); pos = end + 1) {
+        end = all.find('\n', pos);
+        std::string name = all.substr(pos, end - pos);
+        if (bin_name_ids.emplace(name, bin_names.size()).second) bin_names.push_back(name);
+      }
+      for (size_t id = bin_region_ids.size(); id < regions.size(); ++id) bin_region_ids.push_back(bin_name_ids[regions[id]]);
+    }
+    for (BinLogRecord& rec : bin_records) if (rec.region >= 0) rec.region = bin_region_ids[rec.region];
+  }
+
+  // collective: appends the records of all ranks (rank by rank) at the common end of the file
+  void write_binary() {
+    n_batched_lines = 0;
+    sync_binary_regions();
+    uint64_t n = bin_records.size(), n_before = 0, n_total = 0;
+    MPI_Exscan(&n, &n_before, 1, MPI_UINT64_T, MPI_SUM, ci.comm);
+    if (ci.me == 0) n_before = 0;
+    MPI_Allreduce(&n, &n_total, 1, MPI_UINT64_T, MPI_SUM, ci.comm);
+    if (n_total == 0) return;
+    MPI_File_write_at_all(bin_file, bin_offset + n_before * sizeof(BinLogRecord), bin_records.data(),
+                          n * sizeof(BinLogRecord), MPI_BYTE, MPI_STATUS_IGNORE);
+    bin_offset += n_total * sizeof(BinLogRecord);
+    bin_header.n_records += n_total;
+    bin_records.clear();
+  }
+
+  // collective: root appends the region names (common table of all ranks) and rewrites the header
+  void close_binary() {
+    write_binary();
+    if (ci.i_am_root()) {
+      const strvec& name_table = header.empty() ? bin_names : regions;
+      std::string names = join(name_table, "\n");
+      bin_header.n_regions = name_table.size();
+      bin_header.names_offset = bin_offset;
+      bin_header.names_size = names.size();
+      MPI_File_write_at(bin_file, bin_offset, names.data(), names.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+      MPI_File_write_at(bin_file, 0, &bin_header, sizeof(bin_header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&bin_file);
+  }
+
+  void post_async() {
+    if (batch_samples.empty()) return;
+    if (async_cnt == async_ring.size()) complete_async(false, 1);
+    PendingReduce& pr = async_ring[(async_head + async_cnt++) % async_ring.size()];
+    pr.send.swap(batch_samples);
+    batch_samples.clear();
+    pr.recv.resize(ci.i_am_root() ? pr.send.size() : 0);
+    MPI_Ireduce(pr.send.data(), pr.recv.data(), pr.send.size(),
+                mpi_minsummax, mpi_minsummax_op, ci.root, async_comm, &pr.req);
+  }
+
+  // retire posted reductions in order: wait for the oldest n_wait (all if wait_all), then take what is done
+  void complete_async(bool wait_all, size_t n_wait = 0) {
+    while (async_cnt > 0) {
+      PendingReduce& pr = async_ring[async_head];
+      if (wait_all or n_wait > 0) {
+        MPI_Wait(&pr.req, MPI_STATUS_IGNORE);
+        if (n_wait > 0) --n_wait;
+      } else {
+        int done;
+        MPI_Test(&pr.req, &done, MPI_STATUS_IGNORE);
+        if (not done) break;
+      }
+      batch_stats.insert(batch_stats.end(), pr.recv.begin(), pr.recv.end());
+      async_head = (async_head + 1) % async_ring.size();
+      --async_cnt;
+    }
+    replay();
+  }
+
+  // write the buffered output on root as far as the stats have arrived
+  void replay() {
+    while (not batch_events.empty()) {
+      BatchEvent& ev = batch_events.front();
+      switch (ev.kind) {
+        case BatchEvent::SAMPLE:
+          if (batch_stats.size() < (wait_mode ? 2 : 1)) return;
+          time_stat[StatKind::MIN] = batch_stats.front().min;
+          time_stat[StatKind::AVG] = batch_stats.front().sum / ci.n_ranks;
+          time_stat[StatKind::MAX] = batch_stats.front().max;
+          batch_stats.pop_front();
+          if (wait_mode) {
+            wait_stat[StatKind::MIN] = batch_stats.front().min;
+            wait_stat[StatKind::AVG] = batch_stats.front().sum / ci.n_ranks;
+            wait_stat[StatKind::MAX] = batch_stats.front().max;
+            batch_stats.pop_front();
+          }
+          accumulate(ev.region);
+          break;
+        case BatchEvent::WRITE: write_entry(ev.region); break;
+        case BatchEvent::EOL:   eol(); break;
+      }
+      batch_events.pop_front();
+    }
+  }
+
+  // thread mode: called from within after() by any thread (lock free, each thread only touches its own slot)
+  void record_thread(RegionId region, double time) {
+    if (region == NO_REGION) return;
+    ThreadSample& ts = thread_sample(thread_num(), region);
+    ts.time += time;
+    ++ts.n;
+  }
+
+  // thread mode: reduce the line's samples over the threads, then over the ranks and write them (collective)
+  void collect_threads() {
+    const double inf = std::numeric_limits<double>::infinity();
+    thread_stats.assign(3 * header.size(), {inf, 0.0, -inf});
+    for (size_t reg = 0; reg < header.size(); ++reg) {
+      MinSumMax th = {inf, 0.0, -inf};
+      size_t n_active = 0;
+      for (size_t t = 0; t < n_threads; ++t) {
+        ThreadSample& ts = thread_sample(t, reg);
+        if (ts.n == 0) continue;
+        th = {std::min(th.min, ts.time), th.sum + ts.time, std::max(th.max, ts.time)};
+        ++n_active;
+        ts = {0.0, 0};
+      }
+      if (n_active == 0) continue;
+      if (hist_stat) record_hist(reg, th.max);
+      thread_stats[3*reg]     = {th.max, th.max, th.max};             // rank time: slowest thread
+      thread_stats[3*reg + 1] = {th.min, th.sum / n_active, th.max};  // thread imbalance within the rank
+      thread_stats[3*reg + 2] = {1.0, 1.0, 1.0};                      // number of ranks with samples
+    }
+    if (root_stat) {
+      thread_stats_red.resize(ci.i_am_root() ? thread_stats.size() : 0);
+      reduce_minsummax(thread_stats.data(), thread_stats_red.data(), thread_stats.size());
+    } else {
+      thread_stats_red = thread_stats;
+    }
+    if (not fp) return;
+    for (size_t reg = 0; reg < header.size(); ++reg) {
+      double n = thread_stats_red[3*reg + 2].sum;
+      if (n == 0) continue;
+      MinSumMax& rk = thread_stats_red[3*reg];
+      MinSumMax& th = thread_stats_red[3*reg + 1];
+      for (; col_cnt < reg; ++col_cnt) print(na_str);
+      ++col_cnt;
+      if (root_stat) {
+        time_stat[StatKind::MIN] = rk.min;
+        time_stat[StatKind::AVG] = rk.sum / n;
+        time_stat[StatKind::MAX] = rk.max;
+        accumulate(reg);
+        fprintf(fp, "(%f %f %f)", time_stat[0], time_stat[1], time_stat[2]);
+      }
+      fprintf(fp, "[%f %f %f]  ", th.min, th.sum / n, th.max);
+    }
+  }
+
+  void record_hist(RegionId region, double time) {
+    if (region == NO_REGION) return;
+    if (hist.size() < regions.size() * LogHistogram::N_BUCKETS) hist.resize(regions.size() * LogHistogram::N_BUCKETS, 0);
+    LogHistogram::record(&hist[region * LogHistogram::N_BUCKETS], time);
+  }
+
+  // hist mode: percentiles per region; with root_stat of the merged histogram and (min avg max) of the ranks' percentiles
+  void write_percentiles() {
+    constexpr size_t N_QS = 4;
+    const double qs[N_QS] = {0.5, 0.9, 0.99, 0.999};
+    const double inf = std::numeric_limits<double>::infinity();
+    const size_t n_reg = regions.size(), nb = LogHistogram::N_BUCKETS;
+    hist.resize(n_reg * nb, 0);
+
+    std::vector<uint64_t> merged;
+    std::vector<MinSumMax> rank_qs(n_reg * (N_QS + 1), {inf, 0.0, -inf}), rank_qs_red;
+    for (size_t reg = 0; reg < n_reg; ++reg) {
+      if (LogHistogram::count(&hist[reg * nb]) == 0) continue;
+      for (size_t q = 0; q < N_QS; ++q) {
+        double val = LogHistogram::percentile(&hist[reg * nb], qs[q]);
+        rank_qs[reg * (N_QS + 1) + q] = {val, val, val};
+      }
+      rank_qs[reg * (N_QS + 1) + N_QS] = {1.0, 1.0, 1.0};   // number of ranks with samples
+    }
+    if (root_stat) {
+      merged.resize(ci.i_am_root() ? hist.size() : 0);
+      rank_qs_red.resize(ci.i_am_root() ? rank_qs.size() : 0);
+      MPI_Reduce(hist.data(), merged.data(), hist.size(), MPI_UINT64_T, MPI_SUM, ci.root, ci.comm);
+      reduce_minsummax(rank_qs.data(), rank_qs_red.data(), rank_qs.size());
+    } else {
+      merged = hist;
+      rank_qs_red = rank_qs;
+    }
+    if (not fp) return;
+
+    eol();
+    for (size_t q = 0; q < N_QS; ++q) {
+      fprintf(fp, "[p%g]  ", qs[q] * 100);
+      for (size_t reg = 0; reg < n_reg; ++reg) {
+        if (header.empty()) { print(regions[reg]); print(":"); }
+        double n = rank_qs_red[reg * (N_QS + 1) + N_QS].sum;
+        if (n == 0)         print(root_stat ? "   NA   (   NA       NA       NA   )  " : "   NA     ");
+        else if (root_stat) {
+          MinSumMax& rq = rank_qs_red[reg * (N_QS + 1) + q];
+          fprintf(fp, "%f(%f %f %f)  ", LogHistogram::percentile(&merged[reg * nb], qs[q]), rq.min, rq.sum / n, rq.max);
+        } else {
+          fprintf(fp, "%f  ", rank_qs_red[reg * (N_QS + 1) + q].min);
+        }
+      }
+      eol();
+    }
+  }
+
+  bool buffered() { return batch_stat or async_stat; }
+  bool uses_minsummax() { return buffered() or thread_stat or hist_stat or (flagMask & DbgMeasureMode::PERF_STAT); }
+  void set_flush_interval(size_t n) { flush_interval = std::max<size_t>(n, 1); }
+  void set_async_depth(size_t n) { complete_async(true); async_ring.resize(std::max<size_t>(n, 1)); async_head = 0; }
+
+  void print(const std::string& str) { if (fp) fputs(str.c_str(), fp); }
   void printLine(std::string str) { if (fp) fprintf(fp, "%s\n", str.c_str()); col_cnt = 0; }
   void printDbl(double d)         { if (fp) fprintf(fp, "%f ", d); }
   void printStat(double* arr, char ob='(', char cb=')') 
                                   { if (fp) fprintf(fp, "%c%f %f %f%c  ", ob, arr[0], arr[1], arr[2], cb); }
-  void newline()                  { if (fp) fprintf(fp, "\n"); col_cnt = 0; }
+  // max/avg of the runtime, percentage of the time lost waiting at the barrier
+  void printImbalance(const double* rt, const double* wt) {
+    if (fp) fprintf(fp, "[%.3f %5.1f%%]  ", rt[StatKind::MAX] / rt[StatKind::AVG], 100.0 * wt[StatKind::AVG] / (rt[StatKind::AVG] + wt[StatKind::AVG]));
+  }
+  void eol()                      { if (fp) fprintf(fp, "\n"); col_cnt = 0; }
   void space(size_t n=2)          { if (fp) for (size_t i = 0; i < n; ++i) fprintf(fp, " "); }
-  void flush()                    { if (fp) fflush(fp); }
 
-  int index_in_header(std::string s) {
-    for (int i = 0; i < header.size(); ++i) if (s == header[i]) return i;
-    return -1;
+  // NOTE: in batch mode newline() and flush() are collective (every flush_interval-th newline() reduces)
+  //       in async mode newline() writes what has arrived and flush() waits for all pending reductions
+  // NOTE: in thread mode newline() is collective and has to be called outside of parallel regions
+  // NOTE: with sampling, lines without any measured region are skipped
+  void newline() {
+    double t0 = sampling ? MPI_Wtime() : 0.0;
+    bool skip = sampling and not line_written;
+    line_written = false;
+    if (thread_stat) collect_threads();
+    if (binary_stat) {
+      ++bin_line;
+      if (++n_batched_lines >= flush_interval) write_binary();
+    } else if (not buffered()) {
+      if (not skip) eol();
+    } else {
+      if (fp and not skip) batch_events.push_back({BatchEvent::EOL, NO_REGION});
+      if (++n_batched_lines >= flush_interval) collect_batch();
+      if (async_stat) complete_async(false);
+    }
+    if (sampling) {
+      overhead_time += MPI_Wtime() - t0;
+      adapt_sampling();
+    }
+  }
+  void flush() {
+    if (buffered()) { collect_batch(); complete_async(true); }
+    if (binary_stat) write_binary();
+    if (fp) fflush(fp);
+  }
+};
+
+
+// clock policies: now() in seconds, init() is called once per measurer before the first measurement
+struct MPIClock {
+  static void init() { }
+  static double now() { return MPI_Wtime(); }
+};
+
+struct MonotonicRawClock {
+  static void init() { }
+  static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
   }
 };
 
+#if defined(__x86_64__) || defined(__i386__)
+// NOTE: assumes an invariant TSC (constant rate, synchronized across cores)
+struct TscClock {
+  inline static double sec_per_tick = 0.0;
+  static void init() {
+    if (sec_per_tick != 0.0) return;
+    double t0 = MonotonicRawClock::now(), t1;
+    unsigned long long c0 = __rdtsc();
+    while ((t1 = MonotonicRawClock::now()) - t0 < 0.02) { }
+    sec_per_tick = (t1 - t0) / (__rdtsc() - c0);
+  }
+  static double now() { return __rdtsc() * sec_per_tick; }
+};
+#endif
+
+// mode policies: start() at the begin of a region, stop() returns the measured time of the region
+//               (and the wait time at a barrier after it, if the mode measures one)
+struct RunTimeMode {
+  template<class Clock> static double start(CommInfo&) { return Clock::now(); }
+  template<class Clock> static double stop(CommInfo&, double start_time, double&) { return Clock::now() - start_time; }
+};
 
-struct RunTimeMeasurer : TimeMeasurer {
-  RunTimeMeasurer(std::string fname, size_t flagMask, strvec header, CommInfo ci)
-      : TimeMeasurer(fname, flagMask, header, ci) { }
-  
-  void before() override { start_times.push(MPI_Wtime()); }
-  void after(std::string prefix) override {
-    diff_time = MPI_Wtime() - start_times.top();
-    start_times.pop();
-    if (root_stat) collect(prefix);
+struct SyncMode {
+  template<class Clock> static double start(CommInfo& ci) { MPI_Barrier(ci.comm); return 0.0; }
+  template<class Clock> static double stop(CommInfo& ci, double, double&) {
+    double start_time = Clock::now();
+    MPI_Barrier(ci.comm);
+    return Clock::now() - start_time;
   }
 };
 
-struct SyncTimeMeasurer : TimeMeasurer {
-  SyncTimeMeasurer(std::string fname, size_t flagMask, strvec header, CommInfo ci)
-      : TimeMeasurer(fname, flagMask, header, ci) { }
-  
-  void before() override { MPI_Barrier(ci.comm); }
-  void after(std::string prefix) override {
-    double start_time = MPI_Wtime();
+// runtime of the region, then wait time at a single barrier (no barrier before the region)
+struct RunSyncMode {
+  template<class Clock> static double start(CommInfo&) { return Clock::now(); }
+  template<class Clock> static double stop(CommInfo& ci, double start_time, double& wait_time) {
+    double end_time = Clock::now();
     MPI_Barrier(ci.comm);
-    diff_time = MPI_Wtime() - start_time;
-    if (root_stat) collect(prefix);
+    wait_time = Clock::now() - end_time;
+    return end_time - start_time;
+  }
+};
+
+// final -> calls through a PolicyTimeMeasurer* are devirtualized; fixed-size stacks -> no allocations
+// one cache-line aligned start-time stack per (OpenMP) thread
+template<class Clock, class Mode, size_t MaxDepth = 64>
+struct PolicyTimeMeasurer final : TimeMeasurer {
+  struct alignas(64) ThreadStack {
+    double start_times[MaxDepth];
+    size_t depth = 0;
+  };
+  std::vector<ThreadStack> stacks;
+
+  PolicyTimeMeasurer(std::string fname, size_t flagMask, strvec header, CommInfo ci)
+      : TimeMeasurer(fname, flagMask, header, ci), stacks(max_threads()) { Clock::init(); }
+
+  using TimeMeasurer::after;
+  void before() override {
+    ThreadStack& ts = stacks[thread_num()];
+    if (ts.depth == MaxDepth) { fprintf(stderr, "ERROR: measured regions nested deeper than %lu\n", MaxDepth); exit(1); }
+    ts.start_times[ts.depth++] = Mode::template start<Clock>(ci);
+  }
+  void after(RegionId region) override {
+    ThreadStack& ts = stacks[thread_num()];
+    double wait = 0.0;
+    double time = Mode::template stop<Clock>(ci, ts.start_times[--ts.depth], wait);
+    if (thread_stat) record_thread(region, time);
+    else             sample(region, time, wait);
   }
 };
 
+using RunTimeMeasurer  = PolicyTimeMeasurer<MPIClock, RunTimeMode>;
+using SyncTimeMeasurer = PolicyTimeMeasurer<MPIClock, SyncMode>;
+using RunSyncTimeMeasurer = PolicyTimeMeasurer<MPIClock, RunSyncMode>;
+
+template<class Clock>
 static TimeMeasurer* make_TimeMeasurer(std::string fname, size_t flagMask, std::vector<std::string> header, CommInfo ci) {
-  if (flagMask & DbgMeasureMode::RUNTIME)         return new RunTimeMeasurer(fname, flagMask, header, ci);
-  else if (flagMask & DbgMeasureMode::UNSYNCNESS) return new SyncTimeMeasurer(fname, flagMask, header, ci);
+  if ((flagMask & DbgMeasureMode::RUNTIME) and (flagMask & DbgMeasureMode::UNSYNCNESS))
+                                                  return new PolicyTimeMeasurer<Clock, RunSyncMode>(fname, flagMask, header, ci);
+  else if (flagMask & DbgMeasureMode::RUNTIME)    return new PolicyTimeMeasurer<Clock, RunTimeMode>(fname, flagMask, header, ci);
+  else if (flagMask & DbgMeasureMode::UNSYNCNESS) return new PolicyTimeMeasurer<Clock, SyncMode>(fname, flagMask, header, ci);
   else                                            return nullptr;
 }
 
+static TimeMeasurer* make_TimeMeasurer(std::string fname, size_t flagMask, std::vector<std::string> header, CommInfo ci) {
+  return make_TimeMeasurer<MPIClock>(fname, flagMask, header, ci);
+}
+
 //#define DEBUG_MEASURE_ENABLED true
 #if defined(DEBUG_MEASURE_ENABLED) && DEBUG_MEASURE_ENABLED == true
 
@@ -197,6 +1095,15 @@ static TimeMeasurer* make_TimeMeasurer(std::string fname, size_t flagMask, std::
       tm_ptr = make_TimeMeasurer(fname, flagMask, __VA_ARGS__, ci); \
     } while (false)
 
+  // statically typed measurer (e.g. PolicyTimeMeasurer<TscClock, RunTimeMode>): no virtual calls in DEBUG_MEASURE
+  #define DEBUG_MEASURE_ATTRS_T(tm_ptr, tm_type) \
+    tm_type* tm_ptr
+
+  #define DEBUG_MEASURE_SETUP_T(tm_ptr, tm_type, flagMask, ci, fname_base, fname_func, ... /* header list */) do { \
+      char fname[128]; sprintf(fname, "%s-%s-%03i.log", fname_base, fname_func, ci.me); \
+      tm_ptr = new tm_type(fname, flagMask, __VA_ARGS__, ci); \
+    } while (false)
+
   #define DEBUG_MEASURE_DESTROY(tm_ptr) do { \
       if (tm_ptr) delete tm_ptr; \
     } while (false)
@@ -205,12 +1112,25 @@ static TimeMeasurer* make_TimeMeasurer(std::string fname, size_t flagMask, std::
       if (tm_ptr and flags != DbgMeasureMode::OFF) tm_ptr->newline(); \
     } while (false)
 
+  #define DEBUG_MEASURE_FLUSH_INTERVAL(tm_ptr, n) do { \
+      if (tm_ptr) tm_ptr->set_flush_interval(n); \
+    } while (false)
+
+  // measure every n-th invocation per region, adaptively less often if more than max_overhead % of the time is spent measuring
+  #define DEBUG_MEASURE_SAMPLING(tm_ptr, n, max_overhead) do { \
+      if (tm_ptr) tm_ptr->set_sampling(n, max_overhead); \
+    } while (false)
+
+  // prefix: region name (string literal -> hashed at compile time) or RegionId from tm_ptr->region(name)
   #define DEBUG_MEASURE(tm_ptr, flags, prefix, code_block) do { \
-      if (tm_ptr and flags != DbgMeasureMode::OFF ) { \
+      RegionId dbg_measure_region = (tm_ptr and flags != DbgMeasureMode::OFF) ? tm_ptr->region(prefix) : NO_REGION; \
+      if (tm_ptr and flags != DbgMeasureMode::OFF and tm_ptr->sampled(dbg_measure_region)) { \
         tm_ptr->before(); \
+        tm_ptr->enter(dbg_measure_region); \
         { code_block } \
-        tm_ptr->after(prefix); \
-        tm_ptr->write(prefix); \
+        tm_ptr->leave(dbg_measure_region); \
+        tm_ptr->after(dbg_measure_region); \
+        tm_ptr->write(dbg_measure_region); \
       } else { \
         code_block \
       } \
@@ -224,8 +1144,12 @@ static TimeMeasurer* make_TimeMeasurer(std::string fname, size_t flagMask, std::
 
   #define DEBUG_MEASURE_ATTRS(tm_ptr) ;
   #define DEBUG_MEASURE_SETUP(tm_ptr, flagMask, ci, fname_base, fname_func, ... /* header list */) {} 
+  #define DEBUG_MEASURE_ATTRS_T(tm_ptr, tm_type) ;
+  #define DEBUG_MEASURE_SETUP_T(tm_ptr, tm_type, flagMask, ci, fname_base, fname_func, ... /* header list */) {}
   #define DEBUG_MEASURE_DESTROY(tm_ptr) {}
   #define DEBUG_MEASURE_EOL(tm_ptr, flags) {}
+  #define DEBUG_MEASURE_FLUSH_INTERVAL(tm_ptr, n) {}
+  #define DEBUG_MEASURE_SAMPLING(tm_ptr, n, max_overhead) {}
   #define DEBUG_MEASURE(tm_ptr, flags, prefix, code_block) code_block
 
 #endif  // defined(DEBUG_MEASURE_ENABLED) && DEBUG_MEASURE_ENABLED == true
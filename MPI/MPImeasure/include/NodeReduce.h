@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <mpi.h>
+
+// two-level reduction: within the node through a shared memory window (no messages, only the node barrier),
+// then among the node leaders (node rank 0; root is the leader of its node and rank 0 among the leaders)
+// T::reduce(in, inout, len, type) combines on the leader, op among the leaders
+template<class T>
+struct NodeReduce {
+  MPI_Comm node_comm = MPI_COMM_NULL, leader_comm = MPI_COMM_NULL;
+  int node_rank = 0, node_size = 1, n_nodes = 1;
+  MPI_Win win = MPI_WIN_NULL;
+  T* own = nullptr;            // len: 2 * capacity (double buffered -> one barrier per chunk)
+  std::vector<T*> slots;       // leader: window of every rank of the node
+  size_t capacity = 0, parity = 0;
+
+  // collective
+  void init(MPI_Comm comm, int root, size_t cap = 1024) {
+    int me;
+    MPI_Comm_rank(comm, &me);
+    int key = (me == root) ? 0 : me + 1;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, key, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_split(comm, leader() ? 0 : MPI_UNDEFINED, key, &leader_comm);
+    if (leader()) MPI_Comm_size(leader_comm, &n_nodes);
+    MPI_Bcast(&n_nodes, 1, MPI_INT, 0, node_comm);
+
+    capacity = cap;
+    MPI_Win_allocate_shared(2 * capacity * sizeof(T), sizeof(T), MPI_INFO_NULL, node_comm, &own, &win);
+    if (leader()) {
+      slots.resize(node_size);
+      for (int rank = 0; rank < node_size; ++rank) {
+        MPI_Aint size;
+        int disp;
+        MPI_Win_shared_query(win, rank, &size, &disp, &slots[rank]);
+      }
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+  }
+
+  // collective
+  void free() {
+    if (win != MPI_WIN_NULL) {
+      MPI_Win_unlock_all(win);
+      MPI_Win_free(&win);
+    }
+    if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+    if (node_comm != MPI_COMM_NULL) MPI_Comm_free(&node_comm);
+  }
+
+  bool leader() const { return node_rank == 0; }
+
+  // collective on the node: node_recv (leader, len: n) = combination of send over the ranks of the node
+  void reduce_node(const T* send, T* node_recv, size_t n, MPI_Datatype type) {
+    for (size_t off = 0; off < n; off += capacity) {
+      int len = std::min(capacity, n - off);
+      T* buf = own + parity * capacity;
+      std::copy(send + off, send + off + len, buf);
+      MPI_Win_sync(win);
+      MPI_Barrier(node_comm);
+      if (leader()) {
+        MPI_Win_sync(win);
+        std::copy(buf, buf + len, node_recv + off);
+        for (int rank = 1; rank < node_size; ++rank)
+          T::reduce(slots[rank] + parity * capacity, node_recv + off, &len, &type);
+      }
+      parity ^= 1;
+    }
+  }
+
+  // collective: recv (root, len: n) = combination of send over all ranks
+  void reduce(const T* send, T* recv, size_t n, MPI_Datatype type, MPI_Op op) {
+    if (n == 0) return;
+    std::vector<T> node_recv(leader() ? n : 0);
+    reduce_node(send, node_recv.data(), n, type);
+    if (leader()) MPI_Reduce(node_recv.data(), recv, n, type, op, 0, leader_comm);
+  }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#ifdef __linux__
+  #include <unistd.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <linux/perf_event.h>
+#endif
+
+// group of hardware counters of the calling thread (user space only) read with a single read() via perf_event_open
+// -> if the kernel denies access (perf_event_paranoid, containers, no PMU) the events are just not available
+struct PerfCounters {
+  using strvec = std::vector<std::string>;
+  static constexpr size_t MAX_EVENTS = 8;
+
+  strvec names;           // opened events in group order
+  std::vector<int> fds;   // fds[0]: group leader
+  std::string error;      // reason why (some) events are not available
+
+  static strvec default_events() { return {"cycles", "instructions", "llc-misses", "branch-misses"}; }
+
+  PerfCounters() { }
+  PerfCounters(const strvec& events) {
+#ifdef __linux__
+    for (const std::string& name : events) {
+      if (fds.size() == MAX_EVENTS) { error = "too many events"; break; }
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      if (not lookup(name, attr.type, attr.config)) { error = "unknown event '" + name + "'"; continue; }
+      attr.disabled = fds.empty();
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1, fds.empty() ? -1 : fds[0], 0);
+      if (fd < 0) { error = name + ": " + strerror(errno); continue; }
+      fds.push_back(fd);
+      names.push_back(name);
+    }
+    if (not fds.empty()) {
+      ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    error = "perf_event_open requires linux";
+#endif
+  }
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(PerfCounters&& other) {
+    std::swap(names, other.names);
+    std::swap(fds, other.fds);
+    std::swap(error, other.error);
+    return *this;
+  }
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds) close(fd);
+#endif
+  }
+
+  size_t size() const { return fds.size(); }
+  int index(const std::string& name) const {
+    for (size_t i = 0; i < names.size(); ++i) if (names[i] == name) return i;
+    return -1;
+  }
+
+  // values: len >= size(); returns false if the group could not be read
+  bool read(uint64_t* values) const {
+#ifdef __linux__
+    uint64_t buf[1 + MAX_EVENTS];
+    if (fds.empty()) return false;
+    ssize_t len = ::read(fds[0], buf, sizeof(buf));
+    if (len < static_cast<ssize_t>((1 + fds.size()) * sizeof(uint64_t)) or buf[0] < fds.size()) return false;   // all or nothing
+    for (size_t i = 0; i < fds.size(); ++i) values[i] = buf[1 + i];
+    return true;
+#else
+    return false;
+#endif
+  }
+
+#ifdef __linux__
+  static bool lookup(const std::string& name, __u32& type, __u64& config) {
+    auto cache = [](uint64_t id, uint64_t op, uint64_t result) { return id | (op << 8) | (result << 16); };
+    type = PERF_TYPE_HARDWARE;
+    if      (name == "cycles")           config = PERF_COUNT_HW_CPU_CYCLES;
+    else if (name == "instructions")     config = PERF_COUNT_HW_INSTRUCTIONS;
+    else if (name == "cache-references") config = PERF_COUNT_HW_CACHE_REFERENCES;
+    else if (name == "cache-misses")     config = PERF_COUNT_HW_CACHE_MISSES;
+    else if (name == "branches")         config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+    else if (name == "branch-misses")    config = PERF_COUNT_HW_BRANCH_MISSES;
+    else if (name == "stalled-cycles-frontend") config = PERF_COUNT_HW_STALLED_CYCLES_FRONTEND;
+    else if (name == "stalled-cycles-backend")  config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+    else if (name == "page-faults")      { type = PERF_TYPE_SOFTWARE; config = PERF_COUNT_SW_PAGE_FAULTS; }
+    else if (name == "context-switches") { type = PERF_TYPE_SOFTWARE; config = PERF_COUNT_SW_CONTEXT_SWITCHES; }
+    else if (name == "task-clock")       { type = PERF_TYPE_SOFTWARE; config = PERF_COUNT_SW_TASK_CLOCK; }
+    else {
+      type = PERF_TYPE_HW_CACHE;
+      if      (name == "llc-loads")   config = cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+      else if (name == "llc-misses")  config = cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+      else if (name == "l1d-misses")  config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+      else if (name == "dtlb-misses") config = cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+      else return false;
+    }
+    return true;
+  }
+#endif
+};
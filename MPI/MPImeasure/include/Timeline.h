@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <mpi.h>
+
+// offset and drift of the local MPI_Wtime against the one of root, estimated at setup (start) and teardown (stop)
+// from ping-pong rounds; the round with the smallest round trip gives the offset (Cristian's algorithm)
+struct ClockSync {
+  double local0 = 0.0, offset0 = 0.0, rtt0 = 0.0;
+  double local1 = 0.0, offset1 = 0.0, rtt1 = 0.0;
+  double drift = 0.0;
+
+  // collective: root answers each rank in turn with its current time
+  static void measure(int root, int me, int n_ranks, MPI_Comm comm, int rounds, double& local, double& offset, double& rtt) {
+    MPI_Comm sync_comm;
+    MPI_Comm_dup(comm, &sync_comm);
+    local = MPI_Wtime();
+    offset = 0.0;
+    rtt = 0.0;
+    for (int rank = 0; rank < n_ranks; ++rank) {
+      if (rank == root or (me != root and me != rank)) continue;
+      if (me == root) {
+        for (int k = 0; k < rounds; ++k) {
+          double t;
+          MPI_Recv(&t, 1, MPI_DOUBLE, rank, 0, sync_comm, MPI_STATUS_IGNORE);
+          t = MPI_Wtime();
+          MPI_Send(&t, 1, MPI_DOUBLE, rank, 0, sync_comm);
+        }
+      } else {
+        rtt = std::numeric_limits<double>::infinity();
+        for (int k = 0; k < rounds; ++k) {
+          double t_root, t1 = MPI_Wtime();
+          MPI_Send(&t1, 1, MPI_DOUBLE, root, 0, sync_comm);
+          MPI_Recv(&t_root, 1, MPI_DOUBLE, root, 0, sync_comm, MPI_STATUS_IGNORE);
+          double t2 = MPI_Wtime();
+          if (t2 - t1 < rtt) {
+            rtt = t2 - t1;
+            local = 0.5 * (t1 + t2);
+            offset = t_root - local;
+          }
+        }
+      }
+    }
+    MPI_Comm_free(&sync_comm);
+  }
+
+  void start(int root, int me, int n_ranks, MPI_Comm comm, int rounds = 20) {
+    measure(root, me, n_ranks, comm, rounds, local0, offset0, rtt0);
+  }
+  void stop(int root, int me, int n_ranks, MPI_Comm comm, int rounds = 20) {
+    measure(root, me, n_ranks, comm, rounds, local1, offset1, rtt1);
+    drift = (local1 > local0) ? (offset1 - offset0) / (local1 - local0) : 0.0;
+  }
+
+  // local MPI_Wtime -> MPI_Wtime of root (linear interpolation of the offset between start and stop)
+  double global(double t) const { return t + offset0 + drift * (t - local0); }
+};
+
+// start and end time of every measured region (master thread), corrected to the clock of root at the end
+struct Timeline {
+  using strvec = std::vector<std::string>;
+
+  struct Record {
+    int region;
+    double start, end;
+  };
+
+  std::vector<Record> records;
+  std::vector<size_t> stack;    // open records, SIZE_MAX if dropped
+  size_t capacity, n_dropped = 0;
+  ClockSync sync;
+
+  Timeline(size_t capacity = 0) : capacity{capacity} { }
+
+  void enter(int region, double now) {
+    if (records.size() < capacity) {
+      stack.push_back(records.size());
+      records.push_back({region, now, now});
+    } else {
+      stack.push_back(SIZE_MAX);
+      ++n_dropped;
+    }
+  }
+
+  void leave(double now) {
+    size_t rec = stack.back();
+    stack.pop_back();
+    if (rec != SIZE_MAX) records[rec].end = now;
+  }
+
+  // collective: corrects the records to the clock of root, which writes
+  //   <fname_base>.timeline  (merged records of all ranks sorted by start time, seconds since the first start)
+  //   and the arrival skew per region to log: max - min start time over the ranks of the k-th call of the region
+  void export_timeline(std::string fname_base, const strvec& names, FILE* log, int me, int root, int n_ranks, MPI_Comm comm) {
+    for (Record& rec : records) {
+      rec.start = sync.global(rec.start);
+      rec.end = sync.global(rec.end);
+    }
+    double info[5] = {static_cast<double>(records.size()), sync.offset0, sync.drift, std::max(sync.rtt0, sync.rtt1),
+                      static_cast<double>(n_dropped)};
+    if (me != root) {
+      MPI_Send(info, 5, MPI_DOUBLE, root, 0, comm);
+      MPI_Send(records.data(), records.size() * sizeof(Record), MPI_BYTE, root, 0, comm);
+      return;
+    }
+    FILE* fp = fopen((fname_base + ".timeline").c_str(), "w");
+    if (not fp) { fprintf(stderr, "ERROR: unable to open timeline file '%s.timeline'\n", fname_base.c_str()); exit(1); }
+
+    struct RankRecord {
+      int rank;
+      Record rec;
+    };
+    std::vector<RankRecord> all;
+    std::vector<std::vector<std::vector<double>>> starts(names.size(), std::vector<std::vector<double>>(n_ranks));
+    fprintf(fp, "# clock of rank %i: rank offset[s] drift[s/s] max_round_trip[s] dropped\n", root);
+    for (int rank = 0; rank < n_ranks; ++rank) {
+      std::vector<Record> rank_records;
+      double rank_info[5];
+      if (rank == root) {
+        std::copy(info, info + 5, rank_info);
+        rank_records = records;
+      } else {
+        MPI_Recv(rank_info, 5, MPI_DOUBLE, rank, 0, comm, MPI_STATUS_IGNORE);
+        rank_records.resize(rank_info[0]);
+        MPI_Recv(rank_records.data(), rank_records.size() * sizeof(Record), MPI_BYTE, rank, 0, comm, MPI_STATUS_IGNORE);
+      }
+      fprintf(fp, "# %i %e %e %e %.0f\n", rank, rank_info[1], rank_info[2], rank_info[3], rank_info[4]);
+      for (const Record& rec : rank_records) {
+        all.push_back({rank, rec});
+        if (rec.region >= 0 and rec.region < static_cast<int>(names.size())) starts[rec.region][rank].push_back(rec.start);
+      }
+    }
+
+    std::sort(all.begin(), all.end(), [](const RankRecord& a, const RankRecord& b) { return a.rec.start < b.rec.start; });
+    double t0 = all.empty() ? 0.0 : all.front().rec.start;
+    fprintf(fp, "# rank region start end\n");
+    for (const RankRecord& rr : all) {
+      const char* name = (rr.rec.region >= 0 and rr.rec.region < static_cast<int>(names.size())) ? names[rr.rec.region].c_str() : "?";
+      fprintf(fp, "%i %s %.9f %.9f\n", rr.rank, name, rr.rec.start - t0, rr.rec.end - t0);
+    }
+    fclose(fp);
+
+    if (not log) return;
+    fprintf(log, "\n[skew]  [n:calls]  (min avg max)  last rank [n:times]\n");
+    for (size_t reg = 0; reg < names.size(); ++reg) {
+      size_t n_calls = SIZE_MAX;
+      for (int rank = 0; rank < n_ranks; ++rank) n_calls = std::min(n_calls, starts[reg][rank].size());
+      if (n_calls == 0 or n_calls == SIZE_MAX) continue;
+      double skew_min = std::numeric_limits<double>::infinity(), skew_sum = 0.0, skew_max = 0.0;
+      std::vector<size_t> n_last(n_ranks, 0);
+      for (size_t k = 0; k < n_calls; ++k) {
+        int first = 0, last = 0;
+        for (int rank = 1; rank < n_ranks; ++rank) {
+          if (starts[reg][rank][k] < starts[reg][first][k]) first = rank;
+          if (starts[reg][rank][k] > starts[reg][last][k]) last = rank;
+        }
+        double skew = starts[reg][last][k] - starts[reg][first][k];
+        skew_min = std::min(skew_min, skew);
+        skew_sum += skew;
+        skew_max = std::max(skew_max, skew);
+        ++n_last[last];
+      }
+      size_t latest = std::max_element(n_last.begin(), n_last.end()) - n_last.begin();
+      fprintf(log, "%s:  [n:%lu]  (%f %f %f)  %lu [n:%lu]\n", names[reg].c_str(), n_calls,
+              skew_min, skew_sum / n_calls, skew_max, latest, n_last[latest]);
+    }
+  }
+};
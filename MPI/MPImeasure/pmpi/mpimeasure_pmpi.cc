@@ -0,0 +1,283 @@
+/*
+ *  PMPI interposition library: counts calls, bytes and time of the common MPI calls per call site and communicator
+ *    mpirun -np <n> -x LD_PRELOAD=<path>/libmpimeasure_pmpi.so <unmodified application>
+ *
+ *  At MPI_Finalize the statistics are written with a TimeMeasurer (header: one column per call@site@comm, comm:
+ *  world, self or comm(<size>,<world rank of its rank 0>,<hash of its ranks>)):
+ *    line 1: time, line 2: calls, line 3: bytes  -> (min avg max) over the ranks in <base>-pmpi-000.log
+ *    (bytes of Recv/Sendrecv: received size from the status, of Irecv: capacity of the posted buffer)
+ *  environment:
+ *    MPIMEASURE_PMPI_LOG=<base>   base of the log file name (default: mpimeasure)
+ *    MPIMEASURE_PMPI_PER_RANK=1   no reduction, each rank writes its own values to <base>-pmpi-<rank>.log
+ *  NOTE: assumes that MPI is called by one thread at a time (up to MPI_THREAD_SERIALIZED)
+ */
+
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include "MPImeasure.h"
+
+enum PmpiCall { SEND, RECV, ISEND, IRECV, SENDRECV, WAIT, WAITALL, WAITANY, TEST, BARRIER, BCAST, REDUCE, ALLREDUCE,
+                ALLGATHER, ALLTOALL, ALLTOALLV, N_PMPI_CALLS };
+static const char* pmpi_call_names[N_PMPI_CALLS] = {
+  "Send", "Recv", "Isend", "Irecv", "Sendrecv", "Wait", "Waitall", "Waitany", "Test", "Barrier", "Bcast", "Reduce",
+  "Allreduce", "Allgather", "Alltoall", "Alltoallv" };
+
+struct PmpiKey {
+  int call;
+  void* site;
+  int comm;   // index into pmpi_comm_names
+  bool operator==(const PmpiKey& o) const { return call == o.call and site == o.site and comm == o.comm; }
+};
+struct PmpiKeyHash {
+  size_t operator()(const PmpiKey& k) const {
+    return std::hash<void*>()(k.site) ^ (std::hash<int>()(k.call) << 1) ^ (std::hash<int>()(k.comm) << 7);
+  }
+};
+struct PmpiStat {
+  size_t calls = 0;
+  double bytes = 0.0, time = 0.0;
+};
+
+static std::unordered_map<PmpiKey, PmpiStat, PmpiKeyHash> pmpi_stats;
+static bool pmpi_recording = false;
+
+// communicators are named when first used (the handle may be freed before the report, MPI_Comm_free drops it)
+static std::unordered_map<MPI_Comm, int> pmpi_comm_ids;
+static std::map<std::string, int> pmpi_comm_name_ids;
+static std::vector<std::string> pmpi_comm_names;
+
+// same name on all ranks of the communicator (unlike its handle or the order of first use): comm(<size>,<world rank
+// of its rank 0>,<hash of the world ranks of its members>); duplicates of a communicator (same ranks) share the name
+static std::string comm_name(MPI_Comm comm) {
+  if (comm == MPI_COMM_NULL)  return "-";
+  if (comm == MPI_COMM_WORLD) return "world";
+  if (comm == MPI_COMM_SELF)  return "self";
+  int size;
+  MPI_Group group, world_group;
+  PMPI_Comm_size(comm, &size);
+  PMPI_Comm_group(comm, &group);
+  PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  std::vector<int> ranks(size), world_ranks(size);
+  for (int r = 0; r < size; ++r) ranks[r] = r;
+  PMPI_Group_translate_ranks(group, size, ranks.data(), world_group, world_ranks.data());
+  PMPI_Group_free(&group);
+  PMPI_Group_free(&world_group);
+  uint32_t hash = 2166136261u;   // FNV-1a
+  for (int r : world_ranks) hash = (hash ^ static_cast<uint32_t>(r)) * 16777619u;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "comm(%i,%i,%06x)", size, world_ranks[0], hash & 0xffffff);
+  return buf;
+}
+
+static int comm_id(MPI_Comm comm) {
+  auto it = pmpi_comm_ids.find(comm);
+  if (it != pmpi_comm_ids.end()) return it->second;
+  auto name_it = pmpi_comm_name_ids.emplace(comm_name(comm), pmpi_comm_names.size()).first;
+  if (name_it->second == static_cast<int>(pmpi_comm_names.size())) pmpi_comm_names.push_back(name_it->first);
+  return pmpi_comm_ids[comm] = name_it->second;
+}
+
+static void pmpi_record(int call, void* site, MPI_Comm comm, double bytes, double time) {
+  if (not pmpi_recording) return;
+  PmpiStat& st = pmpi_stats[{call, site, comm_id(comm)}];
+  ++st.calls;
+  st.bytes += bytes;
+  st.time += time;
+}
+
+static double type_bytes(int count, MPI_Datatype type) {
+  int size = 0;
+  if (type != MPI_DATATYPE_NULL) PMPI_Type_size(type, &size);
+  return 1.0 * count * size;
+}
+
+// bytes actually received (the posted count is only the capacity of the buffer)
+static double received_bytes(const MPI_Status* status, MPI_Datatype type) {
+  int count = 0;
+  if (PMPI_Get_count(status, type, &count) != MPI_SUCCESS or count == MPI_UNDEFINED) return 0.0;
+  return type_bytes(count, type);
+}
+
+// call site as <module>+0x<offset>, so that it is the same on all ranks despite ASLR
+static std::string site_name(void* site) {
+  Dl_info info;
+  char buf[256];
+  if (dladdr(site, &info) and info.dli_fname) {
+    const char* base = strrchr(info.dli_fname, '/');
+    snprintf(buf, sizeof(buf), "%s+0x%lx", base ? base + 1 : info.dli_fname, (unsigned long)((char*)site - (char*)info.dli_fbase));
+  } else {
+    snprintf(buf, sizeof(buf), "%p", site);
+  }
+  return buf;
+}
+
+// collective: union of the keys of all ranks (sorted), so that every rank reduces the same columns
+static std::vector<std::string> union_keys(const std::vector<std::string>& keys, CommInfo ci) {
+  std::string local;
+  for (const std::string& key : keys) local += key + '\n';
+  int len = local.size();
+  std::vector<int> lens(ci.n_ranks), displs(ci.n_ranks, 0);
+  PMPI_Allgather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, ci.comm);
+  for (int r = 1; r < ci.n_ranks; ++r) displs[r] = displs[r - 1] + lens[r - 1];
+  std::string all(displs.back() + lens.back(), '\0');
+  PMPI_Allgatherv(local.data(), len, MPI_CHAR, &all[0], lens.data(), displs.data(), MPI_CHAR, ci.comm);
+  std::vector<std::string> res = split(all, '\n');
+  std::sort(res.begin(), res.end());
+  res.erase(std::unique(res.begin(), res.end()), res.end());
+  return res;
+}
+
+static void pmpi_report() {
+  pmpi_recording = false;
+  CommInfo ci = CommInfo::getDefault();
+  const char* base = getenv("MPIMEASURE_PMPI_LOG");
+  const char* per_rank = getenv("MPIMEASURE_PMPI_PER_RANK");
+  size_t flagMask = DbgMeasureMode::RUNTIME;
+  if (not (per_rank and atoi(per_rank))) flagMask |= DbgMeasureMode::BATCH_STAT;
+
+  std::map<std::string, PmpiStat> named;   // several sites can resolve to the same name
+  for (auto& kv : pmpi_stats) {
+    std::string key = std::string("MPI_") + pmpi_call_names[kv.first.call] + "@" + site_name(kv.first.site) + "@" + pmpi_comm_names[kv.first.comm];
+    PmpiStat& st = named[key];
+    st.calls += kv.second.calls;
+    st.bytes += kv.second.bytes;
+    st.time += kv.second.time;
+  }
+  std::vector<std::string> keys;
+  for (auto& kv : named) keys.push_back(kv.first);
+  if (flagMask & DbgMeasureMode::BATCH_STAT) keys = union_keys(keys, ci);
+  if (keys.empty()) return;
+
+  char fname[256];
+  snprintf(fname, sizeof(fname), "%s-pmpi-%03i.log", base ? base : "mpimeasure", ci.me);
+  RunTimeMeasurer tm(fname, flagMask, keys, ci);
+  for (int line = 0; line < 3; ++line) {
+    for (RegionId reg = 0; reg < static_cast<RegionId>(keys.size()); ++reg) {
+      auto it = named.find(keys[reg]);
+      PmpiStat st = (it != named.end()) ? it->second : PmpiStat();
+      if (it == named.end() and not (flagMask & DbgMeasureMode::BATCH_STAT)) continue;
+      tm.sample(reg, line == 0 ? st.time : (line == 1 ? st.calls : st.bytes));
+      tm.write(reg);
+    }
+    tm.newline();
+  }
+}
+
+
+extern "C" {
+
+int MPI_Init(int* argc, char*** argv) {
+  int err = PMPI_Init(argc, argv);
+  pmpi_recording = true;
+  return err;
+}
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+  int err = PMPI_Init_thread(argc, argv, required, provided);
+  pmpi_recording = true;
+  return err;
+}
+
+int MPI_Finalize() {
+  pmpi_report();
+  return PMPI_Finalize();
+}
+
+int MPI_Comm_free(MPI_Comm* comm) {
+  pmpi_comm_ids.erase(*comm);
+  return PMPI_Comm_free(comm);
+}
+
+// bytes is evaluated after the call (received sizes from its status)
+#define PMPI_TIMED(call, comm, bytes, pmpi_call) \
+  double pmpi_t0 = PMPI_Wtime(); \
+  int err = pmpi_call; \
+  pmpi_record(call, __builtin_return_address(0), comm, bytes, PMPI_Wtime() - pmpi_t0); \
+  return err;
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+  PMPI_TIMED(SEND, comm, type_bytes(count, type), PMPI_Send(buf, count, type, dest, tag, comm));
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Status* status) {
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) status = &local;
+  PMPI_TIMED(RECV, comm, received_bytes(status, type), PMPI_Recv(buf, count, type, src, tag, comm, status));
+}
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* req) {
+  PMPI_TIMED(ISEND, comm, type_bytes(count, type), PMPI_Isend(buf, count, type, dest, tag, comm, req));
+}
+
+// bytes: capacity of the posted buffer (the received size is only known at completion)
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Request* req) {
+  PMPI_TIMED(IRECV, comm, type_bytes(count, type), PMPI_Irecv(buf, count, type, src, tag, comm, req));
+}
+
+int MPI_Sendrecv(const void* sbuf, int scount, MPI_Datatype stype, int dest, int stag,
+                 void* rbuf, int rcount, MPI_Datatype rtype, int src, int rtag, MPI_Comm comm, MPI_Status* status) {
+  MPI_Status local;
+  if (status == MPI_STATUS_IGNORE) status = &local;
+  PMPI_TIMED(SENDRECV, comm, type_bytes(scount, stype) + received_bytes(status, rtype),
+             PMPI_Sendrecv(sbuf, scount, stype, dest, stag, rbuf, rcount, rtype, src, rtag, comm, status));
+}
+
+int MPI_Wait(MPI_Request* req, MPI_Status* status) {
+  PMPI_TIMED(WAIT, MPI_COMM_NULL, 0, PMPI_Wait(req, status));
+}
+
+int MPI_Waitall(int n, MPI_Request reqs[], MPI_Status statuses[]) {
+  PMPI_TIMED(WAITALL, MPI_COMM_NULL, 0, PMPI_Waitall(n, reqs, statuses));
+}
+
+int MPI_Waitany(int n, MPI_Request reqs[], int* idx, MPI_Status* status) {
+  PMPI_TIMED(WAITANY, MPI_COMM_NULL, 0, PMPI_Waitany(n, reqs, idx, status));
+}
+
+int MPI_Test(MPI_Request* req, int* flag, MPI_Status* status) {
+  PMPI_TIMED(TEST, MPI_COMM_NULL, 0, PMPI_Test(req, flag, status));
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+  PMPI_TIMED(BARRIER, comm, 0, PMPI_Barrier(comm));
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+  PMPI_TIMED(BCAST, comm, type_bytes(count, type), PMPI_Bcast(buf, count, type, root, comm));
+}
+
+int MPI_Reduce(const void* sbuf, void* rbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+  PMPI_TIMED(REDUCE, comm, type_bytes(count, type), PMPI_Reduce(sbuf, rbuf, count, type, op, root, comm));
+}
+
+int MPI_Allreduce(const void* sbuf, void* rbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+  PMPI_TIMED(ALLREDUCE, comm, type_bytes(count, type), PMPI_Allreduce(sbuf, rbuf, count, type, op, comm));
+}
+
+int MPI_Allgather(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount, MPI_Datatype rtype, MPI_Comm comm) {
+  PMPI_TIMED(ALLGATHER, comm, type_bytes(scount, stype),
+             PMPI_Allgather(sbuf, scount, stype, rbuf, rcount, rtype, comm));
+}
+
+int MPI_Alltoall(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount, MPI_Datatype rtype, MPI_Comm comm) {
+  int size;
+  PMPI_Comm_size(comm, &size);
+  PMPI_TIMED(ALLTOALL, comm, type_bytes(scount, stype) * size,
+             PMPI_Alltoall(sbuf, scount, stype, rbuf, rcount, rtype, comm));
+}
+
+int MPI_Alltoallv(const void* sbuf, const int scounts[], const int sdispls[], MPI_Datatype stype,
+                  void* rbuf, const int rcounts[], const int rdispls[], MPI_Datatype rtype, MPI_Comm comm) {
+  int size, n = 0;
+  PMPI_Comm_size(comm, &size);
+  for (int r = 0; r < size; ++r) n += scounts[r];
+  PMPI_TIMED(ALLTOALLV, comm, type_bytes(n, stype),
+             PMPI_Alltoallv(sbuf, scounts, sdispls, stype, rbuf, rcounts, rdispls, rtype, comm));
+}
+
+}  // extern "C"
@@ -0,0 +1,474 @@
+/*
+ *  offline analysis of the per-rank logs of MPImeasure (text logs without ROOT_STAT or a BINARY_STAT file)
+ *    mpimeasure_analyze [-t threads] [-s series_file] [-z outlier_threshold] <log files ... | file.bin>
+ *  text logs are matched to their rank by the -<rank>.log suffix of their name (as DEBUG_MEASURE_SETUP writes them)
+ *
+ *  the k-th sample of a region is matched over the ranks (as the online reductions do) and written to stdout:
+ *    - the totals block of the TimeMeasurer destructor (TOTAL_STAT): [n] SUM MIN AVG MAX of the (min avg max) per sample
+ *    - percentiles of all samples (ranks: min avg max of the per-rank percentile)
+ *    - rank outliers: summed time per region with a robust z-score (median, MAD over the ranks) above the threshold
+ *  -s: per-sample imbalance series (max/avg over the ranks of each region) to series_file
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BinaryLog.h"
+#include "LogHistogram.h"
+
+// read-only mapping of a whole file
+struct MappedFile {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  MappedFile(const char* fname) {
+    int fd = open(fname, O_RDONLY);
+    struct stat st;
+    if (fd < 0 or fstat(fd, &st) != 0) { fprintf(stderr, "ERROR: unable to open '%s'\n", fname); exit(1); }
+    size = st.st_size;
+    if (size > 0) {
+      void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) { fprintf(stderr, "ERROR: unable to mmap '%s'\n", fname); exit(1); }
+      madvise(ptr, size, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(ptr);
+    }
+    close(fd);
+  }
+  ~MappedFile() { if (data) munmap(const_cast<char*>(data), size); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// samples of one rank: time (and wait) of the k-th sample of each region
+struct RankData {
+  std::vector<std::vector<double>> time, wait;
+  bool has_wait = false;
+
+  void add(size_t region, double t, double w) {
+    if (region >= time.size()) { time.resize(region + 1); wait.resize(region + 1); }
+    time[region].push_back(t);
+    if (has_wait) wait[region].push_back(w);
+  }
+  void clear() { for (auto& v : time) v.clear(); for (auto& v : wait) v.clear(); }
+};
+
+// region names: from the header of the logs or registered while parsing (header-less logs)
+struct Regions {
+  std::vector<std::string> names;
+  std::map<std::string, size_t, std::less<>> ids;
+  std::mutex mtx;
+
+  size_t id(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    names.emplace_back(name);
+    return ids[names.back()] = names.size() - 1;
+  }
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return names.size();
+  }
+};
+
+struct StepStat {
+  double min, sum, max;
+  uint32_t n;
+};
+
+// (min sum max) over the ranks of the k-th sample of each region, merged rank by rank (striped locks over k)
+struct StepStats {
+  static constexpr size_t STRIPE = 1024, N_LOCKS = 256;
+  std::vector<std::vector<StepStat>> time, wait;
+  std::shared_mutex resize_mtx;
+  std::mutex locks[N_LOCKS];
+
+  void ensure(size_t n_regions, const RankData& rd) {
+    {
+      std::shared_lock<std::shared_mutex> lock(resize_mtx);
+      bool fits = time.size() >= n_regions;
+      for (size_t reg = 0; fits and reg < rd.time.size(); ++reg) fits = time[reg].size() >= rd.time[reg].size();
+      if (fits) return;
+    }
+    std::unique_lock<std::shared_mutex> lock(resize_mtx);
+    const double inf = std::numeric_limits<double>::infinity();
+    if (time.size() < n_regions) { time.resize(n_regions); wait.resize(n_regions); }
+    for (size_t reg = 0; reg < rd.time.size(); ++reg) {
+      if (time[reg].size() < rd.time[reg].size()) time[reg].resize(rd.time[reg].size(), {inf, 0.0, -inf, 0});
+      if (rd.has_wait and wait[reg].size() < rd.wait[reg].size()) wait[reg].resize(rd.wait[reg].size(), {inf, 0.0, -inf, 0});
+    }
+  }
+
+  static void merge(std::vector<StepStat>& stats, const std::vector<double>& vals, size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+      StepStat& st = stats[k];
+      st.min = std::min(st.min, vals[k]);
+      st.sum += vals[k];
+      st.max = std::max(st.max, vals[k]);
+      ++st.n;
+    }
+  }
+
+  void add(size_t n_regions, const RankData& rd) {
+    ensure(n_regions, rd);
+    std::shared_lock<std::shared_mutex> lock(resize_mtx);
+    for (size_t reg = 0; reg < rd.time.size(); ++reg) {
+      for (size_t begin = 0; begin < rd.time[reg].size(); begin += STRIPE) {
+        size_t end = std::min(begin + STRIPE, rd.time[reg].size());
+        std::lock_guard<std::mutex> stripe(locks[(begin / STRIPE) % N_LOCKS]);
+        merge(time[reg], rd.time[reg], begin, end);
+        if (rd.has_wait) merge(wait[reg], rd.wait[reg], begin, end);
+      }
+    }
+  }
+};
+
+// per-rank results and the merged histograms of a thread
+struct ThreadResult {
+  std::vector<uint64_t> hist;                 // len: regions * LogHistogram::N_BUCKETS
+  std::vector<std::vector<double>> rank_qs;   // per region: rank, p50, p90, p99, p99.9 of each rank
+};
+
+constexpr size_t N_QS = 4;
+constexpr double QS[N_QS] = {0.5, 0.9, 0.99, 0.999};
+
+
+static bool parse_double(std::string_view tok, double& val) {
+  auto res = std::from_chars(tok.data(), tok.data() + tok.size(), val);
+  return res.ec == std::errc() and res.ptr == tok.data() + tok.size();
+}
+
+// "<time>" or "<time>(+<wait>)", with "name:" in front in header-less logs
+static bool parse_entry(std::string_view tok, double& time, double& wait, bool& has_wait) {
+  size_t paren = tok.find("(+");
+  if (paren == std::string_view::npos) return parse_double(tok, time);
+  has_wait = true;
+  if (tok.back() != ')') return false;
+  return parse_double(tok.substr(0, paren), time) and parse_double(tok.substr(paren + 2, tok.size() - paren - 3), wait);
+}
+
+// text log of one rank: header line, then one line per newline() up to the first summary block ('[')
+static void parse_text(const char* fname, bool has_header, Regions& regions, RankData& rd,
+                       std::map<std::string, size_t, std::less<>>& cache) {
+  MappedFile file(fname);
+  const char* p = file.data;
+  const char* end = file.data + file.size;
+  const char* eol = p ? static_cast<const char*>(memchr(p, '\n', end - p)) : nullptr;
+  p = eol ? eol + 1 : end;   // skip the header line
+  const size_t n_cols = has_header ? regions.size() : 0;
+  for (size_t line = 2; p < end and *p != '['; ++line) {
+    eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (not eol) eol = end;
+    size_t col = 0;
+    bool in_na_wait = false;
+    for (const char* q = p; q < eol; ) {
+      while (q < eol and *q == ' ') ++q;
+      if (q == eol) break;
+      const char* tok_end = static_cast<const char*>(memchr(q, ' ', eol - q));
+      if (not tok_end) tok_end = eol;
+      std::string_view tok(q, tok_end - q);
+      q = tok_end;
+      if (tok == "(+" or tok == ")") {   // padding of a header column: "NA" or "NA (+ NA )"
+        in_na_wait = (tok == "(+");
+        continue;
+      }
+      if (tok == "NA") {
+        if (not in_na_wait) ++col;
+        continue;
+      }
+      if (tok.front() == '(') { fprintf(stderr, "ERROR: '%s' is a ROOT_STAT log, not a per-rank log\n", fname); exit(1); }
+      size_t region = col++;
+      // a region written again after a later column of the line (nested regions) is appended without its name
+      if (has_header and region >= n_cols) {
+        fprintf(stderr, "ERROR: '%s' line %zu: more entries than the %zu header columns (region measured twice in a line?)\n",
+                fname, line, n_cols);
+        exit(1);
+      }
+      if (not has_header) {
+        size_t colon = tok.rfind(':', tok.find("(+"));
+        if (colon == std::string_view::npos) continue;   // written without region
+        auto it = cache.find(tok.substr(0, colon));   // thread-local, avoids the lock of the registry
+        if (it == cache.end()) it = cache.emplace(std::string(tok.substr(0, colon)), regions.id(tok.substr(0, colon))).first;
+        region = it->second;
+        tok.remove_prefix(colon + 1);
+      }
+      double time, wait = 0.0;
+      if (not parse_entry(tok, time, wait, rd.has_wait)) {
+        fprintf(stderr, "ERROR: '%s': unable to parse '%.*s'\n", fname, (int)tok.size(), tok.data()); exit(1);
+      }
+      rd.add(region, time, wait);
+    }
+    p = eol + 1;
+  }
+}
+
+static double median(std::vector<double> vals) {
+  if (vals.empty()) return 0.0;
+  std::nth_element(vals.begin(), vals.begin() + vals.size() / 2, vals.end());
+  return vals[vals.size() / 2];
+}
+
+// rank of a text log from the suffix of its name (<base>-<func>-<rank>.log, as DEBUG_MEASURE_SETUP names them)
+static size_t log_rank(const char* fname) {
+  std::string_view name(fname);
+  size_t dash = name.rfind('-');
+  size_t rank = 0;
+  if (name.size() < 4 or name.substr(name.size() - 4) != ".log" or dash == std::string_view::npos or dash + 1 >= name.size() - 4
+      or std::from_chars(fname + dash + 1, fname + name.size() - 4, rank).ptr != fname + name.size() - 4) {
+    fprintf(stderr, "ERROR: '%s': no -<rank>.log suffix\n", fname); exit(1);
+  }
+  return rank;
+}
+
+static void printStat(const double* arr, char ob = '(', char cb = ')') { printf("%c%f %f %f%c  ", ob, arr[0], arr[1], arr[2], cb); }
+
+
+int main(int argc, char** argv) {
+  size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+  const char* series_fname = nullptr;
+  double z_threshold = 3.5;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:s:z:")) != -1) {
+    if (opt == 't')      n_threads = std::max(1, atoi(optarg));
+    else if (opt == 's') series_fname = optarg;
+    else if (opt == 'z') z_threshold = atof(optarg);
+    else { fprintf(stderr, "usage: %s [-t threads] [-s series_file] [-z outlier_threshold] <log files ... | file.bin>\n", argv[0]); exit(1); }
+  }
+  std::vector<const char*> files(argv + optind, argv + argc);
+  if (files.empty()) { fprintf(stderr, "ERROR: no log files given\n"); exit(1); }
+
+  Regions regions;
+  bool has_header = false;
+  size_t n_ranks = files.size();
+  std::vector<size_t> rank_ids(n_ranks);   // rank of the i-th log (text logs sorted by the rank of their name)
+
+  // binary log: runs of records of one rank (records are grouped per flush and rank)
+  bool binary = files.size() == 1 and strlen(files[0]) > 4 and strcmp(files[0] + strlen(files[0]) - 4, ".bin") == 0;
+  MappedFile* bin_file = nullptr;
+  BinLogHeader bin_hdr;
+  std::vector<std::vector<std::pair<size_t, size_t>>> runs;   // per rank
+  if (binary) {
+    bin_file = new MappedFile(files[0]);
+    if (bin_file->size < sizeof(BinLogHeader)) { fprintf(stderr, "ERROR: '%s' is too short\n", files[0]); exit(1); }
+    memcpy(&bin_hdr, bin_file->data, sizeof(bin_hdr));
+    if (memcmp(bin_hdr.magic, BIN_LOG_MAGIC, 8) != 0 or bin_hdr.record_size != sizeof(BinLogRecord)
+        or bin_hdr.names_offset + bin_hdr.names_size > bin_file->size) {
+      fprintf(stderr, "ERROR: '%s' is no MPImeasure binary log\n", files[0]); exit(1);
+    }
+    std::string_view names(bin_file->data + bin_hdr.names_offset, bin_hdr.names_size);
+    for (size_t pos = 0, end; pos < names.size(); pos = end + 1) {
+      end = names.find('\n', pos);
+      if (end == std::string_view::npos) end = names.size();
+      regions.id(names.substr(pos, end - pos));
+    }
+    n_ranks = bin_hdr.n_ranks;
+    rank_ids.resize(n_ranks);
+    for (size_t rank = 0; rank < n_ranks; ++rank) rank_ids[rank] = rank;
+    runs.resize(n_ranks);
+    const BinLogRecord* recs = reinterpret_cast<const BinLogRecord*>(bin_file->data + sizeof(BinLogHeader));
+    for (size_t i = 0; i < bin_hdr.n_records; ++i)
+      if (recs[i].region >= static_cast<int64_t>(regions.names.size())) {
+        fprintf(stderr, "ERROR: '%s': record %zu refers to region %lld of %zu names\n", files[0], i,
+                static_cast<long long>(recs[i].region), regions.names.size());
+        exit(1);
+      }
+    for (size_t begin = 0, end; begin < bin_hdr.n_records; begin = end) {
+      for (end = begin + 1; end < bin_hdr.n_records and recs[end].rank == recs[begin].rank; ++end) { }
+      runs.at(recs[begin].rank).push_back({begin, end});
+    }
+  } else {   // header of the first text log (all logs of one measurer have the same header)
+    std::vector<std::pair<size_t, const char*>> ranked;
+    for (const char* fname : files) ranked.push_back({log_rank(fname), fname});
+    std::sort(ranked.begin(), ranked.end());
+    for (size_t i = 0; i < n_ranks; ++i) {
+      if (i > 0 and ranked[i].first == ranked[i-1].first) { fprintf(stderr, "ERROR: two logs of rank %zu\n", ranked[i].first); exit(1); }
+      rank_ids[i] = ranked[i].first;
+      files[i] = ranked[i].second;
+    }
+    MappedFile first(files[0]);
+    std::string_view line(first.data ? first.data : "", first.size);
+    line = line.substr(0, line.find('\n'));
+    for (size_t pos = 0, end; pos < line.size(); pos = end + 1) {
+      end = line.find(' ', pos);
+      if (end == std::string_view::npos) end = line.size();
+      if (end > pos) regions.id(line.substr(pos, end - pos));
+    }
+    has_header = regions.size() > 0;
+  }
+
+  // parse the ranks in parallel
+  StepStats steps;
+  std::vector<ThreadResult> results(n_threads);
+  std::vector<std::vector<double>> rank_totals(n_ranks);   // per rank: summed time per region
+  std::atomic<size_t> next_rank{0};
+  std::atomic<bool> any_wait{false};
+  auto work = [&](size_t tid) {
+    RankData rd;
+    std::map<std::string, size_t, std::less<>> cache;
+    ThreadResult& res = results[tid];
+    std::vector<uint64_t> rank_hist;
+    for (size_t rank; (rank = next_rank++) < n_ranks; ) {
+      rd.clear();
+      if (binary) {
+        rd.has_wait = (bin_hdr.flags & 1) and (bin_hdr.flags & 2);
+        const BinLogRecord* recs = reinterpret_cast<const BinLogRecord*>(bin_file->data + sizeof(BinLogHeader));
+        for (auto& run : runs[rank])
+          for (size_t i = run.first; i < run.second; ++i)
+            if (recs[i].region >= 0) rd.add(recs[i].region, recs[i].time, recs[i].wait);
+      } else {
+        parse_text(files[rank], has_header, regions, rd, cache);
+      }
+      if (rd.has_wait) any_wait = true;
+      size_t n_reg = std::max(regions.size(), rd.time.size());
+      steps.add(n_reg, rd);
+
+      const size_t nb = LogHistogram::N_BUCKETS;
+      if (res.hist.size() < n_reg * nb) { res.hist.resize(n_reg * nb, 0); res.rank_qs.resize(n_reg); }
+      rank_totals[rank].assign(rd.time.size(), 0.0);
+      for (size_t reg = 0; reg < rd.time.size(); ++reg) {
+        if (rd.time[reg].empty()) continue;
+        rank_hist.assign(nb, 0);
+        for (double t : rd.time[reg]) {
+          LogHistogram::record(rank_hist.data(), t);
+          rank_totals[rank][reg] += t;
+        }
+        for (size_t b = 0; b < nb; ++b) res.hist[reg * nb + b] += rank_hist[b];
+        res.rank_qs[reg].push_back(rank);
+        for (size_t q = 0; q < N_QS; ++q) res.rank_qs[reg].push_back(LogHistogram::percentile(rank_hist.data(), QS[q]));
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; ++t) threads.emplace_back(work, t);
+  for (std::thread& th : threads) th.join();
+  delete bin_file;
+
+  const size_t n_reg = regions.names.size(), nb = LogHistogram::N_BUCKETS;
+  const bool wait_mode = any_wait;
+  enum { MIN, AVG, MAX, SUM };
+
+  // totals block as written by the destructor of TimeMeasurer with TOTAL_STAT
+  auto totals = [&](const std::vector<StepStat>& stats, double (&tot)[4][3], size_t& n) {
+    for (size_t col = MIN; col <= MAX; ++col) { tot[MIN][col] = std::numeric_limits<double>::infinity(); tot[MAX][col] = 0.0; tot[SUM][col] = 0.0; }
+    n = 0;
+    for (const StepStat& st : stats) {
+      if (st.n == 0) continue;
+      double stat[3] = {st.min, st.sum / st.n, st.max};
+      for (size_t col = MIN; col <= MAX; ++col) {
+        tot[MIN][col] = std::min(tot[MIN][col], stat[col]);
+        tot[MAX][col] = std::max(tot[MAX][col], stat[col]);
+        tot[SUM][col] += stat[col];
+      }
+      ++n;
+    }
+    for (size_t col = MIN; col <= MAX; ++col) tot[AVG][col] = n ? tot[SUM][col] / n : 0.0;
+  };
+  std::vector<double[4][3]> time_tot(n_reg), wait_tot(n_reg);
+  std::vector<size_t> n_samples(n_reg, 0);
+  for (size_t reg = 0; reg < n_reg; ++reg) {
+    size_t n_wait;
+    totals(reg < steps.time.size() ? steps.time[reg] : std::vector<StepStat>(), time_tot[reg], n_samples[reg]);
+    totals(reg < steps.wait.size() ? steps.wait[reg] : std::vector<StepStat>(), wait_tot[reg], n_wait);
+  }
+
+  printf("%zu ranks, %zu regions%s\n", n_ranks, n_reg, wait_mode ? ", runtime and wait time" : "");
+  for (size_t reg = 0; reg < n_reg; ++reg) printf("%s ", regions.names[reg].c_str());
+  printf("\n");
+  for (size_t reg = 0; reg < n_reg; ++reg) printf("[n:%lu]  ", n_samples[reg]);
+  printf("\n");
+  for (size_t row : {(size_t)SUM, (size_t)MIN, (size_t)AVG, (size_t)MAX}) {
+    for (size_t reg = 0; reg < n_reg; ++reg) printStat(time_tot[reg][row], '[', ']');
+    printf("\n");
+  }
+  if (wait_mode) {
+    for (size_t reg = 0; reg < n_reg; ++reg) printStat(wait_tot[reg][SUM], '<', '>');
+    printf("\n");
+    for (size_t reg = 0; reg < n_reg; ++reg) {
+      double (&rt)[3] = time_tot[reg][SUM];
+      double (&wt)[3] = wait_tot[reg][SUM];
+      printf("[%.3f %5.1f%%]  ", rt[MAX] / rt[AVG], 100.0 * wt[AVG] / (rt[AVG] + wt[AVG]));
+    }
+    printf("\n");
+  }
+
+  // percentiles of all samples (over the ranks: min avg max of the percentile of each rank)
+  std::vector<uint64_t> hist(n_reg * nb, 0);
+  for (ThreadResult& res : results)
+    for (size_t i = 0; i < std::min(hist.size(), res.hist.size()); ++i) hist[i] += res.hist[i];
+  printf("\n");
+  for (size_t q = 0; q < N_QS; ++q) {
+    printf("[p%g]  ", QS[q] * 100);
+    for (size_t reg = 0; reg < n_reg; ++reg) {
+      double rq[3] = {std::numeric_limits<double>::infinity(), 0.0, 0.0};
+      size_t n = 0;
+      for (ThreadResult& res : results) {
+        if (reg >= res.rank_qs.size()) continue;
+        for (size_t i = 0; i < res.rank_qs[reg].size(); i += N_QS + 1, ++n) {
+          double val = res.rank_qs[reg][i + 1 + q];
+          rq[0] = std::min(rq[0], val);
+          rq[1] += val;
+          rq[2] = std::max(rq[2], val);
+        }
+      }
+      if (n == 0) { printf("   NA   (   NA       NA       NA   )  "); continue; }
+      rq[1] /= n;
+      printf("%f(%f %f %f)  ", LogHistogram::percentile(&hist[reg * nb], QS[q]), rq[0], rq[1], rq[2]);
+    }
+    printf("\n");
+  }
+
+  // rank outliers: robust z-score 0.6745 * (x - median) / MAD of the summed time per region
+  printf("\n[outliers]  region rank total z (|z| > %g)\n", z_threshold);
+  for (size_t reg = 0; reg < n_reg; ++reg) {
+    std::vector<double> tot(n_ranks), dev(n_ranks);
+    for (size_t rank = 0; rank < n_ranks; ++rank) tot[rank] = reg < rank_totals[rank].size() ? rank_totals[rank][reg] : 0.0;
+    double med = median(tot);
+    for (size_t rank = 0; rank < n_ranks; ++rank) dev[rank] = std::fabs(tot[rank] - med);
+    double mad = median(dev);
+    for (size_t rank = 0; rank < n_ranks; ++rank) {
+      double z = (mad > 0.0) ? 0.6745 * (tot[rank] - med) / mad : 0.0;
+      if (std::fabs(z) > z_threshold) printf("%s  %zu  %f  %.2f\n", regions.names[reg].c_str(), rank_ids[rank], tot[rank], z);
+    }
+  }
+
+  // imbalance series: max/avg over the ranks of the k-th sample of each region
+  if (series_fname) {
+    FILE* fp = fopen(series_fname, "w");
+    if (not fp) { fprintf(stderr, "ERROR: unable to open '%s'\n", series_fname); exit(1); }
+    fprintf(fp, "# sample");
+    for (size_t reg = 0; reg < n_reg; ++reg) fprintf(fp, " %s", regions.names[reg].c_str());
+    fprintf(fp, "\n");
+    size_t n_max = 0;
+    for (size_t reg = 0; reg < steps.time.size(); ++reg) n_max = std::max(n_max, steps.time[reg].size());
+    for (size_t k = 0; k < n_max; ++k) {
+      fprintf(fp, "%zu", k);
+      for (size_t reg = 0; reg < n_reg; ++reg) {
+        if (reg < steps.time.size() and k < steps.time[reg].size() and steps.time[reg][k].sum > 0.0) {
+          const StepStat& st = steps.time[reg][k];
+          fprintf(fp, " %.4f", st.max / (st.sum / st.n));
+        } else {
+          fprintf(fp, " NA");
+        }
+      }
+      fprintf(fp, "\n");
+    }
+    fclose(fp);
+  }
+  return 0;
+}
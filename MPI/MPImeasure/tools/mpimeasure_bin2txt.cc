@@ -0,0 +1,94 @@
+/*
+ *  converts a BINARY_STAT file of MPImeasure into the text logs
+ *    mpimeasure_bin2txt <file.bin> text <out_base>   -> <out_base>-<rank>.log per rank (format of the per-rank logs)
+ *    mpimeasure_bin2txt <file.bin> columns           -> stdout: rank line region time wait (one record per line)
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "BinaryLog.h"
+
+static void usage(const char* prog) {
+  fprintf(stderr, "usage: %s <file.bin> text <out_base>\n       %s <file.bin> columns\n", prog, prog);
+  exit(1);
+}
+
+static void read_at(FILE* fp, uint64_t offset, void* buf, size_t size, const char* what) {
+  if (fseek(fp, offset, SEEK_SET) != 0 or fread(buf, 1, size, fp) != size) {
+    fprintf(stderr, "ERROR: unable to read %s\n", what); exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) usage(argv[0]);
+  std::string mode = argv[2];
+  if (not (mode == "columns" or (mode == "text" and argc == 4))) usage(argv[0]);
+
+  FILE* in = fopen(argv[1], "rb");
+  if (not in) { fprintf(stderr, "ERROR: unable to open '%s'\n", argv[1]); exit(1); }
+  BinLogHeader hdr;
+  read_at(in, 0, &hdr, sizeof(hdr), "header");
+  if (memcmp(hdr.magic, BIN_LOG_MAGIC, 8) != 0 or hdr.version != BIN_LOG_VERSION or hdr.record_size != sizeof(BinLogRecord)) {
+    fprintf(stderr, "ERROR: '%s' is no MPImeasure binary log (version %u)\n", argv[1], BIN_LOG_VERSION); exit(1);
+  }
+  std::vector<BinLogRecord> records(hdr.n_records);
+  read_at(in, sizeof(hdr), records.data(), records.size() * sizeof(BinLogRecord), "records");
+  std::string names_str(hdr.names_size, '\0');
+  read_at(in, hdr.names_offset, &names_str[0], names_str.size(), "region names");
+  fclose(in);
+  std::vector<std::string> names;
+  for (size_t pos = 0, end; pos < names_str.size(); pos = end + 1) {
+    end = names_str.find('\n', pos);
+    if (end == std::string::npos) end = names_str.size();
+    names.push_back(names_str.substr(pos, end - pos));
+  }
+
+  // flags of DbgMeasureMode: RUNTIME and UNSYNCNESS -> runtime and wait time
+  bool wait_mode = (hdr.flags & 1) and (hdr.flags & 2);
+  auto name_of = [&](int32_t region) { return (region >= 0 and region < (int32_t)names.size()) ? names[region].c_str() : "-"; };
+
+  if (mode == "columns") {
+    printf("# ranks: %u  regions: %u  flags: %lu  wtick: %g  wtime_is_global: %u  wtime_start: %f\n",
+           hdr.n_ranks, hdr.n_regions, (unsigned long)hdr.flags, hdr.wtick, hdr.wtime_is_global, hdr.wtime_start);
+    printf("# rank line region time wait\n");
+    for (const BinLogRecord& rec : records)
+      printf("%i %lu %s %f %f\n", rec.rank, (unsigned long)rec.line, name_of(rec.region), rec.time, rec.wait);
+    return 0;
+  }
+
+  // records are grouped per flush and rank -> stable sort keeps the write order of each rank
+  std::stable_sort(records.begin(), records.end(), [](const BinLogRecord& a, const BinLogRecord& b) { return a.rank < b.rank; });
+  const char* na_str = wait_mode ? "   NA   (+   NA   ) " : "   NA   ";
+  size_t rec = 0;
+  for (uint32_t rank = 0; rank < hdr.n_ranks; ++rank) {
+    char fname[512];
+    snprintf(fname, sizeof(fname), "%s-%03u.log", argv[3], rank);
+    FILE* out = fopen(fname, "w");
+    if (not out) { fprintf(stderr, "ERROR: unable to open '%s'\n", fname); exit(1); }
+    if (hdr.has_header) for (const std::string& name : names) fprintf(out, "%s ", name.c_str());
+    fprintf(out, "\n");
+    uint64_t line = 0;
+    size_t col_cnt = 0;
+    bool line_open = false;
+    for (; rec < records.size() and records[rec].rank == (int32_t)rank; ++rec) {
+      const BinLogRecord& r = records[rec];
+      for (; line < r.line; ++line, col_cnt = 0, line_open = false) fprintf(out, "\n");
+      line_open = true;
+      if (not hdr.has_header) {
+        if (r.region != -1) fprintf(out, "%s:", name_of(r.region));
+      } else if (r.region != -1) {
+        for (; col_cnt < static_cast<size_t>(r.region); ++col_cnt) fputs(na_str, out);
+        ++col_cnt;
+      }
+      if (wait_mode) fprintf(out, "%f(+%f) ", r.time, r.wait);
+      else           fprintf(out, "%f ", r.time);
+    }
+    if (line_open) fprintf(out, "\n");
+    fclose(out);
+  }
+  return 0;
+}
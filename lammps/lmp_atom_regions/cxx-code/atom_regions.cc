@@ -1,9 +1,11 @@
 /*
- *  Note: this program has not been finished! - Use the finished reimplementation written in Nim
+ *  C++ reimplementation of lmp_atom_regions, for very large numbers of regions:
+ *  the region borders are calculated on the fly and the commands are streamed through a fixed size buffer
  */
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -11,174 +13,54 @@
 #include <cstdint>
 #include <cassert>
 #include "utils.h"
-
-constexpr int N_DIMS = 3;
-
-
-enum class GridStyle {
-  Tensor,
-  Staggered
-};
-
-template<class T>
-struct Triple {
-  T x, y, z;
-  Triple() : x(0), y(0), z(0) { }
-  Triple(T x, T y, T z) : x{x}, y{y}, z{z} { }
-  T sum() { return x + y + z; }
-  T prod() { return x * y * z; }
-};
-
-struct Cell {
-  //double borders[2*N_DIMS];
-  double x_low, x_high;
-  double y_low, y_high;
-  double z_low, z_high;
-  std::string name;
-  Cell(std::string name) : name{name} { }
-};
-
-struct Cuts {
-  // interface: x, y, z
-  // internal:  z, y, x
-  bool zero_one_scale;
-  Triple<int> dim;
-  GridStyle grid;
-  std::vector<double> z_cuts;
-  std::vector<double> y_cuts;
-  std::vector<double> x_cuts;
-  Cuts(int x, int y, int z, GridStyle grid) : dim(x, y, z), grid{grid}, zero_one_scale{true} {
-    if (grid == GridStyle::Tensor) {
-      z_cuts = std::vector<double>(z+1, 0);
-      y_cuts = std::vector<double>(y+1, 0);
-      x_cuts = std::vector<double>(x+1, 0);
-    } else if (grid == GridStyle::Staggered) {
-      z_cuts = std::vector<double>(z+1, 0);
-      y_cuts = std::vector<double>(z * (y+1), 0);
-      x_cuts = std::vector<double>(z * y * (x+1), 0);
-    }
-  }
-
-  Cuts(int x, int y, int z, GridStyle grid, std::vector<double> zyx_cut_params, bool zero_one_scale = true) : Cuts(x, y, z, grid) {
-    this->zero_one_scale = zero_one_scale;
-    assert(z_cuts.size() + y_cuts.size() + x_cuts.size() == zyx_cut_params.size());
-    std::copy(z_cuts.begin(), z_cuts.end(), zyx_cut_params.begin());
-    std::copy(y_cuts.begin(), y_cuts.end(), zyx_cut_params.begin()+z_cuts.size());
-    std::copy(x_cuts.begin(), x_cuts.end(), zyx_cut_params.begin()+z_cuts.size()+y_cuts.size());
-  }
-
-  Cuts operator*(Triple<int>& lens) {
-    if (not zero_one_scale)
-      error_msg("The Cuts are not on a 0-1 scale and can't be rescaled anymore!");
-    Cuts res(*this);
-    for (double& val : res.z_cuts) val *= lens.z;
-    for (double& val : res.y_cuts) val *= lens.y;
-    for (double& val : res.x_cuts) val *= lens.x;
-    res.zero_one_scale = false;
-    return res;
-  }
-
-  friend std::vector<double> complete_zero_one_scale(std::vector<double> zyx_cut_params, GridStyle grid) {
-    // TODO: make a minimalistic cut-list complete
-    //      otherwise only accept already complete cut lists
-    return zyx_cut_params;
-  }
-};
-
-struct System {
-  Triple<int> procs, lens;
-  Cuts cuts;
-  std::vector<Cell> cells;      // len: procs.prod()
-
-  System(Triple<int> procs, Triple<int> lens, Cuts cuts, double region_gap = 0) : procs{procs}, lens{lens}, cuts{cuts} {
-    // scale cuts
-    if (cuts.zero_one_scale) cuts = cuts * lens;
-    // calculate cell-borders
-    for (int reg = 0; reg < procs.prod(); ++reg) {
-      Triple<int> coord = idx_to_coord(reg);
-      Cell cell("reg" + to_wdtstr(reg, 2));
-      cell.z_low  = cuts.z_cuts[coord.z]     + region_gap/2;
-      cell.z_high = cuts.z_cuts[coord.z + 1] - region_gap/2;
-      if (cuts.grid == GridStyle::Tensor) {
-        cell.y_low  = cuts.y_cuts[coord.y]     + region_gap/2;
-        cell.y_high = cuts.y_cuts[coord.y + 1] - region_gap/2;
-        cell.x_low  = cuts.x_cuts[coord.x]     + region_gap/2;
-        cell.x_high = cuts.x_cuts[coord.x + 1] - region_gap/2;
-      } else if (cuts.grid == GridStyle::Staggered) {
-        cell.y_low  = cuts.y_cuts[coord.z * (procs.y + 1) + coord.y]     + region_gap/2;
-        cell.y_high = cuts.y_cuts[coord.z * (procs.y + 1) + coord.y + 1] - region_gap/2;
-        cell.x_low  = cuts.x_cuts[coord.z * (procs.y + 1) * (procs.x + 1) + coord.y * (procs.x + 1) + coord.x]     + region_gap/2;
-        cell.x_high = cuts.x_cuts[coord.z * (procs.y + 1) * (procs.x + 1) + coord.y * (procs.x + 1) + coord.x + 1] - region_gap/2;
-      }
-      cells.push_back(cell);
-    }
-  }
-
-  std::string lmp_style_regions() {
-    // "region  <region-name>  <kind=>block  <x-low> <x-high> <y-low> <y-high> <z-low> <z-high>"
-    std::stringstream lmp_cmd;
-    for (auto& cell : cells) {
-      lmp_cmd << "region  " << cell.name << "  block  "
-              << cell.x_low << " " << cell.x_high << "  "
-              << cell.y_low << " " << cell.y_high << "  "
-              << cell.z_low << " " << cell.z_high << std::endl;
-    }
-    return lmp_cmd.str();
-  }
-
-  std::string lmp_style_create(int n_particles_per_region=1000, int seed=873984, bool inc_seed=true) {
-    // "create_atoms  <atom_kind=1>  random  <n-atoms> <seed> <region-name>"
-    std::stringstream lmp_cmd;
-    for (auto& cell : cells) {
-      lmp_cmd << "create_atoms  1  random  "
-              << n_particles_per_region << " "
-              << seed << " "
-              << cell.name << std::endl;
-      if (inc_seed) seed += 1;
-    }
-    return lmp_cmd.str();
-  }
-
-  int coord_to_idx(Triple<int> c) {
-    return c.z * (procs.y * procs.x) + c.y * procs.x + c.x;
-  }
-
-  Triple<int> idx_to_coord(int idx) {
-    Triple<int> coord;
-    coord.x = idx % procs.x;
-    coord.y = (idx % (procs.x * procs.y)) / procs.x;
-    coord.z = idx / (procs.x * procs.y);
-    return coord;
-  }
-};
+#include "system.h"
 
 
 
 
 /**
- *  interface: ./atom_regions <grid>  <procs-x> <procs-y> <procs-z>  <len-x> <len-y> <len-z>  <region-gap>  <cut-parameters>
- *    grid:                       tensor or staggered (string)
+ *  interface: ./atom_regions [--data <data-file>] [--order <order>]  <grid>  <procs-x> <procs-y> <procs-z>  <len-x> <len-y> <len-z>  <region-gap>  <atom-params>  <cut-parameters>
+ *    --data:                     write the atoms to a LAMMPS data file (generated in parallel) and
+ *                                read_data it instead of the create_atoms commands
+ *    --order:                    numbering of the regions (names, seeds): row-major (z-y-x, default), morton or hilbert
+ *                                (tensor and staggered grids)
+ *    grid:                       tensor, staggered or tiled (string)
  *    procs-x, procs-y, procs-z:  number of processors in direction x, y and z (int)
- *    len-x, len-y, len-z:        length of the system in dimension x, y and z (int)
+ *    len-x, len-y, len-z:        length of the system in dimension x, y and z (float)
  *    region-gap:                 gap between regions
- *    cut-parameters:             comma separated list of cuts in order of z, y, x (float in ]0,1[)
- *                                  for tensor   grid exactly  (procs-z - 1) + (procs-y - 1) + (procs-x - 1)  values
- *                                  for staggerd grid exactly  (procs-z - 1) + procs-z * (procs-y - 1) + procs-z * procs-y * (procs-x - 1)  values
+ *    atom-params:                <natoms-per-region>,<seed>,<inc-seed?>
+ *    cut-parameters:             comma separated list of cuts in order of z, y, x (float in [0,1], incl. 0 and 1 of every cut vector)
+ *                                  for tensor   grid exactly  (procs-z + 1) + (procs-y + 1) + (procs-x + 1)  values
+ *                                  for staggerd grid exactly  (procs-z + 1) + procs-z * (procs-y + 1) + procs-z * procs-y * (procs-x + 1)  values
+ *                                  for tiled    grid exactly  procs-x * procs-y * procs-z - 1  pairs of <dim(0: x, 1: y, 2: z)>,<ratio>
+ *                                or @<file> with the list in its first line
  */
 int main(int argc, char* argv[]) {
-  // TODO: add option to choose between tensor and staggered grid
+  std::string data_fname;
+  RegionOrder order = RegionOrder::RowMajor;
+  for (; argc > 2 && std::string(argv[1]).rfind("--", 0) == 0; argv += 2, argc -= 2) {
+    if (std::string(argv[1]) == "--data")       data_fname = argv[2];
+    else if (std::string(argv[1]) == "--order") order = parse_region_order(argv[2]);
+    else error_msg("Unknown option %s\n", argv[1]);
+  }
+
   // check number of arguments
-  int argn = 1 + 2 * N_DIMS + 2;
+  int argn = 1 + 2 * N_DIMS + 3;
   if (argc-1 != argn)
     error_msg("This program requires %i arguments!\n" \
-      "./atom_regions <grid>  <procs-x> <procs-y> <procs-z>  <len-x> <len-y> <len-z>  <region-gap>  <cut-params>\n" \
-      "  grid:                      tensor or staggered (string)\n" \
+      "./atom_regions [--data <data-file>] [--order <order>]  <grid>  <procs-x> <procs-y> <procs-z>  <len-x> <len-y> <len-z>  <region-gap>  <atom-params>  <cut-params>\n" \
+      "  --data:                    write the atoms to a LAMMPS data file and read_data it instead of create_atoms\n" \
+      "  --order:                   numbering of the regions: row-major (default), morton or hilbert (tensor and staggered grids)\n" \
+      "  grid:                      tensor, staggered or tiled (string)\n" \
       "  procs-x, procs-y, procs-z: number of processors in direction x, y and z (int)\n" \
-      "  len-x, len-y, len-z:       length of the system in dimension x, y and z (int)\n" \
+      "  len-x, len-y, len-z:       length of the system in dimension x, y and z (float)\n" \
       "  region-gap:                gap between regions\n" \
-      "  cut-parameters:            comma separated list of cuts in order of z, y, x (float in ]0,1[)\n" \
-      "                               tensor   grid: exactly (procs-z - 1) + (procs-y - 1) + (procs-x - 1) values\n" \
-      "                               staggerd grid: exactly (procs-z - 1) + procs-z * (procs-y - 1) + procs-z * procs-y * (procs-x - 1) values\n",
+      "  atom-params:               <natoms-per-region>,<seed>,<inc-seed?>\n" \
+      "  cut-parameters:            comma separated list of cuts in order of z, y, x (float in [0,1], incl. 0 and 1)\n" \
+      "                               tensor   grid: exactly (procs-z + 1) + (procs-y + 1) + (procs-x + 1) values\n" \
+      "                               staggerd grid: exactly (procs-z + 1) + procs-z * (procs-y + 1) + procs-z * procs-y * (procs-x + 1) values\n" \
+      "                               tiled    grid: exactly procs-x * procs-y * procs-z - 1 pairs of <dim(0: x, 1: y, 2: z)>,<ratio>\n" \
+      "                             or @<file> with the list in its first line\n",
       argn);
 
 
@@ -188,20 +70,46 @@ int main(int argc, char* argv[]) {
   GridStyle grid;
   if (args[cnt] == "tensor")         grid = GridStyle::Tensor;
   else if (args[cnt] == "staggered") grid = GridStyle::Staggered;
-  else  error_msg("ERROR: Unknown grid style %s\n", argv);
+  else if (args[cnt] == "tiled")     grid = GridStyle::Tiled;
+  else  error_msg("Unknown grid style %s\n", args[cnt].data());
   ++cnt;
 
-  double region_gap = 0.0; // 0.001
-  if (argc-1 == 2 * N_DIMS + 1) {
-    region_gap = std::atof(argv[2*N_DIMS+1]);
-  }
-
-  // parse arguments
-  //System sys(argv+1, region_gap);
+  Triple<int> procs(std::atoi(argv[cnt+1]), std::atoi(argv[cnt+2]), std::atoi(argv[cnt+3]));
+  cnt += N_DIMS;
+  if (procs.x < 1 || procs.y < 1 || procs.z < 1) error_msg("The number of processors has to be positive in every dimension\n");
+  Triple<double> lens(std::atof(argv[cnt+1]), std::atof(argv[cnt+2]), std::atof(argv[cnt+3]));
+  cnt += N_DIMS;
 
-  //std::cout << sys.lmp_style_regions() << std::endl;
+  double region_gap = std::atof(argv[cnt+1]);
+  ++cnt;
 
-  //std::cout << sys.lmp_style_create() << std::endl;
+  std::vector<std::string> atom_args;
+  std::stringstream atom_sstr(args[cnt++]);
+  for (std::string arg; std::getline(atom_sstr, arg, ',');) atom_args.push_back(arg);
+  if (atom_args.size() != 3) error_msg("invalid atom parameters: %s\n", args[cnt-1].data());
+  AtomParams atom_params{std::atol(atom_args[0].data()), std::atol(atom_args[1].data()), parse_bool(atom_args[2])};
+
+  // @<file>: cut parameters read from file (a staggered grid with 10^6 regions exceeds the maximal argument length)
+  std::string cut_csv = args[cnt++];
+  if (cut_csv[0] == '@') {
+    std::ifstream cut_file(cut_csv.substr(1));
+    if (not cut_file) error_msg("unable to open %s\n", cut_csv.data() + 1);
+    std::getline(cut_file, cut_csv);
+  }
+  System sys = System::make(grid, procs, lens, parse_csv(cut_csv), region_gap);
+  sys.set_order(order);
+
+  // same output as the Nim version: region commands, empty line, atom creation commands
+  OutBuffer out;
+  sys.lmp_style_regions(out);
+  out.write('\n');
+  if (data_fname.empty()) {
+    sys.lmp_style_create(out, atom_params);
+  } else {
+    sys.write_lmp_data(data_fname, atom_params);
+    sys.lmp_style_read_data(out, data_fname);
+  }
+  out.write('\n');
 
   return 0;
 }
@@ -0,0 +1,120 @@
+/*
+ *  offline load-balance evaluation: atom counts per region of cut sets (as random_cuts emits them in csv mode)
+ *  for the atoms of a LAMMPS dump or data file, without running LAMMPS
+ *  the file is memory-mapped and parsed once, the atoms of every cut set are assigned to the regions in parallel
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include "utils.h"
+#include "system.h"
+#include "positions.h"
+
+struct BalanceStats {
+  long max, min;
+  double avg;
+  double imbalance() const { return max / avg; }
+};
+
+// atom counts per region (len: sys.n_regions())
+std::vector<long> region_counts(const System& sys, const Positions& pos) {
+  constexpr size_t BLOCK = 4096;
+  std::vector<long> counts(sys.n_regions(), 0);
+  size_t n_atoms = pos.size();
+  #pragma omp parallel
+  {
+    std::vector<long> local(counts.size(), 0);
+    int32_t regions[BLOCK];
+    #pragma omp for schedule(static)
+    for (size_t first = 0; first < n_atoms; first += BLOCK) {
+      size_t len = std::min(BLOCK, n_atoms - first);
+      sys.locate(&pos.xyz[3 * first], len, regions);
+      for (size_t i = 0; i < len; ++i) ++local[regions[i]];
+    }
+    #pragma omp critical
+    for (size_t reg = 0; reg < counts.size(); ++reg) counts[reg] += local[reg];
+  }
+  return counts;
+}
+
+BalanceStats balance_stats(const std::vector<long>& counts, size_t n_atoms) {
+  auto [min, max] = std::minmax_element(counts.begin(), counts.end());
+  return BalanceStats{*max, *min, static_cast<double>(n_atoms) / counts.size()};
+}
+
+
+/**
+ *  interface: ./balance_eval [-c] <dump|data-file>  <grid>  <procs-x> <procs-y> <procs-z>  <cut-sets> ...
+ *    -c:                         also write the atom count of every region
+ *    dump|data-file:             LAMMPS dump (first snapshot; x y z, xu yu zu or xs ys zs columns) or data file
+ *                                (atom style atomic, charge, molecular, bond, angle, full or sphere)
+ *    grid:                       tensor, staggered or tiled (string)
+ *    procs-x, procs-y, procs-z:  number of processors in direction x, y and z (int)
+ *    cut-sets:                   cut parameters as for atom_regions (relative to the box of the file)
+ *                                or @<file> with one cut set per line (e.g. the output of random_cuts --batch <n> csv)
+ *  output: one line per cut set: <set> <imbalance (max/avg)> <max> <avg> <min> [<counts (csv)>]
+ */
+int main(int argc, char* argv[]) {
+  bool write_counts = (argc > 1 && std::string(argv[1]) == "-c");
+  if (write_counts) { ++argv; --argc; }
+  int argn = 2 + N_DIMS + 1;
+  if (argc-1 < argn)
+    error_msg("This program requires at least %i arguments!\n" \
+      "./balance_eval [-c] <dump|data-file>  <grid>  <procs-x> <procs-y> <procs-z>  <cut-sets> ...\n" \
+      "  -c:                        also write the atom count of every region\n" \
+      "  dump|data-file:            LAMMPS dump (first snapshot; x y z, xu yu zu or xs ys zs columns) or data file\n" \
+      "  grid:                      tensor, staggered or tiled (string)\n" \
+      "  procs-x, procs-y, procs-z: number of processors in direction x, y and z (int)\n" \
+      "  cut-sets:                  cut parameters as for atom_regions (relative to the box of the file)\n" \
+      "                             or @<file> with one cut set per line (e.g. the output of random_cuts --batch <n> csv)\n",
+      argn);
+
+  // parse arguments
+  std::vector<std::string> args = toStrVec(argc-1, argv+1);
+  int cnt = 1;
+  GridStyle grid;
+  if (args[cnt] == "tensor")         grid = GridStyle::Tensor;
+  else if (args[cnt] == "staggered") grid = GridStyle::Staggered;
+  else if (args[cnt] == "tiled")     grid = GridStyle::Tiled;
+  else  error_msg("Unknown grid style %s\n", args[cnt].data());
+  ++cnt;
+
+  Triple<int> procs(std::atoi(argv[cnt+1]), std::atoi(argv[cnt+2]), std::atoi(argv[cnt+3]));
+  cnt += N_DIMS;
+  if (procs.x < 1 || procs.y < 1 || procs.z < 1) error_msg("The number of processors has to be positive in every dimension\n");
+
+  Positions pos = read_positions(args[0].data());
+  if (pos.size() == 0) error_msg("no atoms in %s\n", args[0].data());
+
+  OutBuffer out;
+  size_t set = 0;
+  auto evaluate = [&](const std::string& cut_csv) {
+    System sys = System::make(grid, procs, pos.lens, parse_csv(cut_csv));
+    std::vector<long> counts = region_counts(sys, pos);
+    BalanceStats stats = balance_stats(counts, pos.size());
+    char line[128];
+    out.write(std::string_view(line, std::snprintf(line, sizeof(line), "%zu %.6f %ld %.3f %ld",
+                                                   set++, stats.imbalance(), stats.max, stats.avg, stats.min)));
+    if (write_counts)
+      for (size_t reg = 0; reg < counts.size(); ++reg) {
+        out.write(reg ? ',' : ' ');
+        out.write_int(counts[reg]);
+      }
+    out.write('\n');
+  };
+
+  for (; cnt < static_cast<int>(args.size()); ++cnt) {
+    if (args[cnt][0] != '@') { evaluate(args[cnt]); continue; }
+    std::ifstream cut_file(args[cnt].substr(1));
+    if (not cut_file) error_msg("unable to open %s\n", args[cnt].data() + 1);
+    for (std::string cut_csv; std::getline(cut_file, cut_csv);)
+      if (not cut_csv.empty()) evaluate(cut_csv);
+  }
+
+  return 0;
+}
@@ -0,0 +1,585 @@
+/*
+ *  offline balancer-convergence simulator: the atoms of a LAMMPS dump or data file are loaded and sorted once,
+ *  then many runs (random initial cuts of random_cuts, or given cut sets) are rebalanced step by step without
+ *  LAMMPS, the imbalance (max/avg atoms per region) after every step is reported over the runs
+ *  per step only the atoms between the old and the new position of a moved cut are reassigned:
+ *    tensor:    balance shift xyz (LAMMPS Balance::adjust: bisection of the cut towards the equal-count target
+ *               within the bracket of the current cuts), the slabs of the atoms of the moved strips updated
+ *    staggered: the same per z-slab (y cuts) and y-column (x cuts) on the sorted atoms of every slab and column,
+ *               the strips of the moved cuts move between the slabs/columns (removal and merge of the sorted sets)
+ *    tiled:     RCB step with the initial cut dimensions: the cut of every node is bisected from its current
+ *               position towards the weight proportion of its subtrees, on the sorted atoms of every node; the
+ *               cuts are absolute positions (a cut moves when it is shifted or its cell shrinks past it)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include "utils.h"
+#include "grids.h"
+#include "positions.h"
+
+
+// atom coordinates scaled to [0, 1] and every axis sorted once (values and atom indices)
+struct Atoms {
+  size_t n = 0;
+  std::vector<double> xyz;
+  std::vector<double> sorted[3];
+  std::vector<int32_t> order[3];
+
+  double coord(size_t atom, int dim) const { return xyz[3*atom + dim]; }
+  // order along dim, ties by index
+  bool before(int32_t a, int32_t b, int dim) const {
+    return coord(a, dim) < coord(b, dim) || (coord(a, dim) == coord(b, dim) && a < b);
+  }
+};
+
+Atoms load_atoms(const char* fname) {
+  Positions pos = read_positions(fname);
+  Atoms atoms;
+  atoms.n = pos.size();
+  atoms.xyz = std::move(pos.xyz);
+  const double lens[3] = {pos.lens.x, pos.lens.y, pos.lens.z};
+  #pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < atoms.n; ++i)
+    for (int dim = 0; dim < N_DIMS; ++dim) atoms.xyz[3*i + dim] = std::clamp(atoms.xyz[3*i + dim] / lens[dim], 0.0, 1.0);
+  #pragma omp parallel for schedule(static)
+  for (int dim = 0; dim < N_DIMS; ++dim) {
+    std::vector<int32_t>& order = atoms.order[dim];
+    order.resize(atoms.n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b) { return atoms.before(a, b, dim); });
+    atoms.sorted[dim].resize(atoms.n);
+    for (size_t k = 0; k < atoms.n; ++k) atoms.sorted[dim][k] = atoms.coord(order[k], dim);
+  }
+  return atoms;
+}
+
+
+struct ShiftParams {
+  int niter;          // bisection iterations per cut and step
+  double stopthresh;  // no shift of a cut vector whose slabs are balanced below (max/avg)
+};
+
+// number of values of the sorted range [begin, end) below pos
+inline size_t count_below(const double* begin, const double* end, double pos) {
+  return std::lower_bound(begin, end, pos) - begin;
+}
+
+// balance shift of one cut vector (len: n+1, incl. 0 and 1) of total atoms, below(pos): atoms below pos;
+// false: balanced (not shifted)
+template<class Below>
+bool shift_cuts(double* cuts, int n, size_t total, Below below, const ShiftParams& sp) {
+  if (n < 2 || total == 0) return false;
+  std::vector<size_t> sums(n + 1);
+  sums[0] = 0;
+  sums[n] = total;
+  for (int j = 1; j < n; ++j) sums[j] = below(cuts[j]);
+  size_t max_slab = 0;
+  for (int j = 0; j < n; ++j) max_slab = std::max(max_slab, sums[j+1] - sums[j]);
+  if (max_slab <= sp.stopthresh * total / n) return false;
+
+  std::vector<double> new_cuts(cuts, cuts + n + 1);
+  for (int i = 1; i < n; ++i) {
+    double target = static_cast<double>(i) * total / n;
+    int j = std::upper_bound(sums.begin(), sums.end(), target) - sums.begin() - 1;
+    j = std::clamp(j, 0, n - 1);
+    double lo = cuts[j], hi = cuts[j+1];
+    for (int m = 0; m < sp.niter; ++m) {
+      double mid = 0.5 * (lo + hi);
+      if (below(mid) < target) lo = mid;
+      else                     hi = mid;
+    }
+    new_cuts[i] = 0.5 * (lo + hi);
+  }
+  std::copy(new_cuts.begin(), new_cuts.end(), cuts);
+  return true;
+}
+
+double imbalance(const std::vector<long>& counts, size_t n_atoms) {
+  return *std::max_element(counts.begin(), counts.end()) / (static_cast<double>(n_atoms) / counts.size());
+}
+
+
+// atoms of a slab, column or RCB node in the order along dim (ids and coordinates): removal and merge walk the
+// moved atoms in this order, locate them by galloping from the previous one and copy the runs between them
+struct SortedAtoms {
+  int dim = 0;
+  std::vector<int32_t> ids;
+  std::vector<double> pos;
+
+  size_t size() const { return ids.size(); }
+  size_t below(double x) const { return std::lower_bound(pos.begin(), pos.end(), x) - pos.begin(); }
+  void push_back(double x, int32_t a) {
+    ids.push_back(a);
+    pos.push_back(x);
+  }
+
+  using Key = std::pair<double, int32_t>;
+  bool before(size_t k, const Key& key) const { return pos[k] < key.first || (pos[k] == key.first && ids[k] < key.second); }
+  // index of the atom of key (or where it belongs), not before index first
+  size_t find(const Key& key, size_t first) const {
+    size_t step = 1;
+    while (first + step <= size() && before(first + step - 1, key)) step *= 2;
+    size_t lo = first + step / 2, hi = std::min(first + step - 1, size());
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (before(mid, key)) lo = mid + 1;
+      else                  hi = mid;
+    }
+    return lo;
+  }
+  std::vector<Key> keys(const Atoms& atoms, const std::vector<int32_t>& moved) const {
+    std::vector<Key> res;
+    res.reserve(moved.size());
+    for (int32_t a : moved) res.emplace_back(atoms.coord(a, dim), a);
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  // leaving: atoms of the set
+  void remove(const Atoms& atoms, const std::vector<int32_t>& leaving) {
+    if (leaving.empty()) return;
+    size_t out = 0, k = 0;
+    for (const Key& key : keys(atoms, leaving)) {
+      size_t at = find(key, k);
+      for (; k < at; ++k, ++out) {
+        ids[out] = ids[k];
+        pos[out] = pos[k];
+      }
+      k = at + 1;
+    }
+    for (; k < size(); ++k, ++out) {
+      ids[out] = ids[k];
+      pos[out] = pos[k];
+    }
+    ids.resize(out);
+    pos.resize(out);
+  }
+  // incoming: atoms to add
+  void merge(const Atoms& atoms, const std::vector<int32_t>& incoming) {
+    SortedAtoms merged{dim};
+    merged.ids.reserve(size() + incoming.size());
+    merged.pos.reserve(size() + incoming.size());
+    size_t k = 0;
+    for (const Key& key : keys(atoms, incoming)) {
+      size_t next = find(key, k);
+      merged.ids.insert(merged.ids.end(), ids.begin() + k, ids.begin() + next);
+      merged.pos.insert(merged.pos.end(), pos.begin() + k, pos.begin() + next);
+      merged.push_back(key.first, key.second);
+      k = next;
+    }
+    merged.ids.insert(merged.ids.end(), ids.begin() + k, ids.end());
+    merged.pos.insert(merged.pos.end(), pos.begin() + k, pos.end());
+    std::swap(*this, merged);
+  }
+};
+
+struct Move {
+  int32_t atom, from, to;
+};
+
+// sets of all atoms (owner: set of every atom) in the order of the sorted axis: sorted without sorting
+void fill_sets(const Atoms& atoms, std::vector<SortedAtoms>& sets, const std::vector<int32_t>& owner) {
+  int dim = sets[0].dim;
+  for (SortedAtoms& set : sets) set = SortedAtoms{dim};
+  for (size_t k = 0; k < atoms.n; ++k) sets[owner[atoms.order[dim][k]]].push_back(atoms.sorted[dim][k], atoms.order[dim][k]);
+}
+
+// moves of atoms between the sets (owner updated): the sets that lost atoms drop them, the sets that gained atoms
+// merge them in; refilled when many atoms move (first steps from random cuts)
+void move_atoms(const Atoms& atoms, std::vector<SortedAtoms>& sets, const std::vector<int32_t>& owner, const std::vector<Move>& moves) {
+  if (moves.size() > atoms.n / 8) {
+    fill_sets(atoms, sets, owner);
+    return;
+  }
+  std::vector<std::vector<int32_t>> groups(sets.size());
+  for (const Move& move : moves) groups[move.from].push_back(move.atom);
+  for (size_t set = 0; set < sets.size(); ++set) sets[set].remove(atoms, groups[set]);
+  for (std::vector<int32_t>& group : groups) group.clear();
+  for (const Move& move : moves) groups[move.to].push_back(move.atom);
+  for (size_t set = 0; set < sets.size(); ++set)
+    if (not groups[set].empty()) sets[set].merge(atoms, groups[set]);
+}
+
+
+// tensor grid: slab index of every atom per dimension, counts updated by the atoms of the moved strips
+struct TensorRun {
+  const Atoms& atoms;
+  int dims[3];
+  std::vector<double> cuts[3];
+  std::vector<int32_t> slab[3];
+  std::vector<long> counts;
+
+  TensorRun(const Atoms& atoms, const int dims_[3], const std::vector<double>& params) : atoms{atoms} {
+    std::copy(dims_, dims_ + 3, dims);
+    auto param = params.begin();
+    for (int dim = 2; dim >= 0; --dim) {
+      cuts[dim].assign(param, param + dims[dim] + 1);
+      param += dims[dim] + 1;
+    }
+    counts.assign(static_cast<size_t>(dims[0]) * dims[1] * dims[2], 0);
+    for (int dim = 0; dim < N_DIMS; ++dim) {
+      slab[dim].resize(atoms.n);
+      for (size_t a = 0; a < atoms.n; ++a) slab[dim][a] = Cuts::interval(cuts[dim].data(), dims[dim], atoms.coord(a, dim));
+    }
+    for (size_t a = 0; a < atoms.n; ++a) ++counts[region(a)];
+  }
+
+  long region(size_t a) const { return (static_cast<long>(slab[2][a]) * dims[1] + slab[1][a]) * dims[0] + slab[0][a]; }
+
+  void step(const ShiftParams& sp) {
+    for (int dim = 0; dim < N_DIMS; ++dim) {
+      const double* begin = atoms.sorted[dim].data();
+      const double* end = begin + atoms.n;
+      std::vector<double> old = cuts[dim];
+      auto below = [&](double pos) { return count_below(begin, end, pos); };
+      if (not shift_cuts(cuts[dim].data(), dims[dim], atoms.n, below, sp)) continue;
+      for (int i = 1; i < dims[dim]; ++i) {
+        size_t from = below(std::min(old[i], cuts[dim][i]));
+        size_t to = below(std::max(old[i], cuts[dim][i]));
+        for (size_t k = from; k < to; ++k) {
+          int32_t a = atoms.order[dim][k];
+          int32_t s = Cuts::interval(cuts[dim].data(), dims[dim], begin[k]);
+          if (s == slab[dim][a]) continue;
+          --counts[region(a)];
+          slab[dim][a] = s;
+          ++counts[region(a)];
+        }
+      }
+    }
+  }
+};
+
+
+// staggered grid: the atoms of every slab sorted by y and of every column sorted by x
+struct StaggeredRun {
+  const Atoms& atoms;
+  int dims[3];
+  std::vector<double> z_cuts, y_cuts, x_cuts;
+  std::vector<int32_t> slab, column;         // per atom
+  std::vector<SortedAtoms> slabs, columns;
+  std::vector<long> counts;
+
+  StaggeredRun(const Atoms& atoms, const int dims_[3], const std::vector<double>& params) : atoms{atoms} {
+    std::copy(dims_, dims_ + 3, dims);
+    size_t n_z = dims[2] + 1, n_y = static_cast<size_t>(dims[2]) * (dims[1] + 1);
+    z_cuts.assign(params.begin(), params.begin() + n_z);
+    y_cuts.assign(params.begin() + n_z, params.begin() + n_z + n_y);
+    x_cuts.assign(params.begin() + n_z + n_y, params.end());
+    slab.resize(atoms.n);
+    column.resize(atoms.n);
+    for (size_t a = 0; a < atoms.n; ++a) {
+      slab[a] = Cuts::interval(z_cuts.data(), dims[2], atoms.coord(a, 2));
+      column[a] = column_of(a);
+    }
+    slabs.assign(dims[2], SortedAtoms{1});
+    columns.assign(static_cast<size_t>(dims[2]) * dims[1], SortedAtoms{0});
+    fill_sets(atoms, slabs, slab);
+    fill_sets(atoms, columns, column);
+    counts.assign(static_cast<size_t>(dims[0]) * dims[1] * dims[2], 0);
+    recount();
+  }
+
+  double* y_vec(int s) { return &y_cuts[static_cast<size_t>(s) * (dims[1] + 1)]; }
+  double* x_vec(size_t col) { return &x_cuts[col * (dims[0] + 1)]; }
+  int32_t column_of(size_t a) { return slab[a] * dims[1] + Cuts::interval(y_vec(slab[a]), dims[1], atoms.coord(a, 1)); }
+
+  // counts from the positions of the x cuts in the sorted columns
+  void recount() {
+    for (size_t col = 0; col < columns.size(); ++col) {
+      const double* cuts = x_vec(col);
+      size_t lower = 0;
+      for (int x = 0; x < dims[0]; ++x) {
+        size_t upper = (x + 1 < dims[0]) ? columns[col].below(cuts[x+1]) : columns[col].size();
+        counts[col * dims[0] + x] = upper - lower;
+        lower = upper;
+      }
+    }
+  }
+
+  void step(const ShiftParams& sp) {
+    std::vector<int32_t> touched;   // atoms whose column may change
+    std::vector<Move> moves;
+
+    // z: the atoms between the old and new position of a moved cut change slab
+    const double* z = atoms.sorted[2].data();
+    auto z_below = [&](double pos) { return count_below(z, z + atoms.n, pos); };
+    std::vector<double> old = z_cuts;
+    if (shift_cuts(z_cuts.data(), dims[2], atoms.n, z_below, sp)) {
+      for (int i = 1; i < dims[2]; ++i)
+        for (size_t k = z_below(std::min(old[i], z_cuts[i])); k < z_below(std::max(old[i], z_cuts[i])); ++k) {
+          int32_t a = atoms.order[2][k];
+          int32_t s = Cuts::interval(z_cuts.data(), dims[2], z[k]);
+          if (s == slab[a]) continue;
+          moves.push_back({a, slab[a], s});
+          slab[a] = s;
+          touched.push_back(a);
+        }
+      move_atoms(atoms, slabs, slab, moves);
+    }
+
+    // y per slab: the atoms between the old and new position of a moved cut change column
+    for (int s = 0; s < dims[2]; ++s) {
+      SortedAtoms& set = slabs[s];
+      auto y_below = [&](double pos) { return set.below(pos); };
+      old.assign(y_vec(s), y_vec(s) + dims[1] + 1);
+      if (not shift_cuts(y_vec(s), dims[1], set.size(), y_below, sp)) continue;
+      for (int i = 1; i < dims[1]; ++i)
+        for (size_t k = y_below(std::min(old[i], y_vec(s)[i])); k < y_below(std::max(old[i], y_vec(s)[i])); ++k)
+          touched.push_back(set.ids[k]);
+    }
+    moves.clear();
+    for (int32_t a : touched) {
+      int32_t col = column_of(a);
+      if (col == column[a]) continue;   // also the second time an atom is touched
+      moves.push_back({a, column[a], col});
+      column[a] = col;
+    }
+    move_atoms(atoms, columns, column, moves);
+
+    // x per column (the counts follow from the cut positions)
+    for (size_t col = 0; col < columns.size(); ++col)
+      shift_cuts(x_vec(col), dims[0], columns[col].size(), [&](double pos) { return columns[col].below(pos); }, sp);
+    recount();
+  }
+};
+
+
+// tiled grid: cut tree in heap layout (as RCBTree) with absolute cut positions, the atoms of the cell of every
+// node sorted along its cut dimension, the atom counts of the regions (slots)
+struct TiledRun {
+  const Atoms& atoms;
+  size_t n_cuts;
+  std::vector<uint8_t> cutdims;
+  std::vector<double> cutpos;
+  std::vector<size_t> leaves;              // regions below a node
+  std::vector<SortedAtoms> nodes;
+  std::vector<Cell> cells;
+  std::vector<long> counts;
+
+  TiledRun(const Atoms& atoms, const int dims[3], const std::vector<double>& params)
+    : atoms{atoms}, n_cuts{static_cast<size_t>(dims[0]) * dims[1] * dims[2] - 1} {
+    leaves.assign(2 * n_cuts + 1, 1);
+    for (size_t node = n_cuts; node-- > 0;) leaves[node] = leaves[2*node+1] + leaves[2*node+2];
+    cells.assign(2 * n_cuts + 1, Cell{0.0, 1.0, 0.0, 1.0, 0.0, 1.0});
+    nodes.resize(n_cuts);
+    for (size_t node = 0; node < n_cuts; ++node) {
+      int dim = static_cast<int>(params[2*node]);
+      Cell& cell = cells[node];
+      cutdims.push_back(dim);
+      cutpos.push_back(cell.low(dim) + params[2*node+1] * (cell.high(dim) - cell.low(dim)));
+      nodes[node].dim = dim;
+      split_cell(node);
+    }
+    // the slot of every atom, then the node sets in the order of the sorted axes (ancestors of the slot)
+    std::vector<uint32_t> slot(atoms.n);
+    counts.assign(n_cuts + 1, 0);
+    for (size_t a = 0; a < atoms.n; ++a) {
+      slot[a] = descend(0, a);
+      ++counts[slot[a] - n_cuts];
+    }
+    for (int dim = 0; dim < N_DIMS; ++dim)
+      for (int32_t a : atoms.order[dim])
+        for (uint32_t node = slot[a]; node > 0;) {
+          node = (node - 1) / 2;
+          if (cutdims[node] == dim) nodes[node].push_back(atoms.coord(a, dim), a);
+        }
+  }
+
+  // slot of atom a below node
+  uint32_t descend(uint32_t node, int32_t a) const {
+    while (node < n_cuts) node = 2 * node + 1 + (atoms.coord(a, cutdims[node]) >= cutpos[node]);
+    return node;
+  }
+
+  void split_cell(size_t node) {
+    int dim = cutdims[node];
+    for (size_t kid : {2*node+1, 2*node+2}) cells[kid] = cells[node];
+    cells[2*node+1].high(dim) = cutpos[node];
+    cells[2*node+2].low(dim) = cutpos[node];
+  }
+
+  // atoms (of one side of a moved cut) leave the subtree of node / enter the subtree of node
+  void remove_below(size_t node, std::vector<int32_t>& ids) {
+    if (ids.empty()) return;
+    if (node >= n_cuts) { counts[node - n_cuts] -= ids.size(); return; }
+    nodes[node].remove(atoms, ids);
+    auto [left, right] = split(node, ids);
+    remove_below(2*node+1, left);
+    remove_below(2*node+2, right);
+  }
+  void insert_below(size_t node, std::vector<int32_t>& ids) {
+    if (ids.empty()) return;
+    if (node >= n_cuts) { counts[node - n_cuts] += ids.size(); return; }
+    nodes[node].merge(atoms, ids);
+    auto [left, right] = split(node, ids);
+    insert_below(2*node+1, left);
+    insert_below(2*node+2, right);
+  }
+  std::pair<std::vector<int32_t>, std::vector<int32_t>> split(size_t node, const std::vector<int32_t>& ids) const {
+    std::pair<std::vector<int32_t>, std::vector<int32_t>> res;
+    for (int32_t a : ids) (atoms.coord(a, cutdims[node]) < cutpos[node] ? res.first : res.second).push_back(a);
+    return res;
+  }
+
+  // the atoms between the old and the new position change the side of the cut
+  void move_cut(size_t node, double pos) {
+    const SortedAtoms& set = nodes[node];
+    size_t from = set.below(std::min(pos, cutpos[node])), to = set.below(std::max(pos, cutpos[node]));
+    std::vector<int32_t> strip(set.ids.begin() + from, set.ids.begin() + to);
+    bool to_left = pos > cutpos[node];
+    remove_below(to_left ? 2*node+2 : 2*node+1, strip);
+    cutpos[node] = pos;
+    strip.assign(set.ids.begin() + from, set.ids.begin() + to);
+    insert_below(to_left ? 2*node+1 : 2*node+2, strip);
+  }
+
+  // nodes in heap order (parents first): cut clamped to the (new) cell, then shifted
+  void step(const ShiftParams& sp) {
+    for (size_t node = 0; node < n_cuts; ++node) {
+      const SortedAtoms& set = nodes[node];
+      double low = cells[node].low(cutdims[node]), high = cells[node].high(cutdims[node]);
+      double cur = std::clamp(cutpos[node], low, high);
+      if (cur != cutpos[node]) move_cut(node, cur);
+      double n = set.size();
+      double target = n * leaves[2*node+1] / leaves[node];
+      size_t n_below = set.below(cur);
+      bool balanced = n_below <= sp.stopthresh * target + 0.5 && n - n_below <= sp.stopthresh * (n - target) + 0.5;
+      if (not balanced && high > low) {
+        double lo = (n_below < target) ? cur : low, hi = (n_below < target) ? high : cur;
+        for (int m = 0; m < sp.niter; ++m) {
+          double mid = 0.5 * (lo + hi);
+          if (set.below(mid) < target) lo = mid;
+          else                        hi = mid;
+        }
+        move_cut(node, 0.5 * (lo + hi));
+      }
+      split_cell(node);
+    }
+  }
+};
+
+
+// imbalance after every step (len: n_steps+1)
+template<class Run>
+void simulate(Run run, size_t n_atoms, int n_steps, const ShiftParams& sp, double* imbalances) {
+  imbalances[0] = imbalance(run.counts, n_atoms);
+  for (int step = 1; step <= n_steps; ++step) {
+    run.step(sp);
+    imbalances[step] = imbalance(run.counts, n_atoms);
+  }
+}
+
+
+/**
+ *  interface: ./balance_sim [-n <steps>] [-i <niter>] [-s <stopthresh>]  <dump|data-file>  <grid>  <nx> <ny> <nz>  <min-dist>  <runs>
+ *    -n:              number of rebalancing steps (default: 20)
+ *    -i:              bisection iterations per cut and step (Niter of balance shift, default: 5)
+ *    -s:              stopthresh: cut vectors (tiled: nodes) balanced below max/avg are not shifted (default: 1.0)
+ *    dump|data-file:  atom coordinates of a LAMMPS dump or data file (as balance_eval)
+ *    grid:            tensor, staggered or tiled (string)
+ *    nx, ny, nz:      number of regions in direction x, y and z (int)
+ *    min-dist:        minimal distance of the random initial cuts (as random_cuts)
+ *    runs:            <first-seed>:<n-seeds>: initial cuts of random_cuts csv <grid> <nx> <ny> <nz> <min-dist> <seed>
+ *                     or @<file> with one cut set per line (e.g. the output of random_cuts --batch <n> csv)
+ *  output: imbalance (max/avg atoms per region) over the runs after every step: mean min median max
+ */
+int main(int argc, char* argv[]) {
+  int n_steps = 20;
+  ShiftParams sp{5, 1.0};
+  for (; argc > 2 && argv[1][0] == '-' && argv[1][1] != '\0' && argv[1][2] == '\0'; argv += 2, argc -= 2) {
+    if (argv[1][1] == 'n')      n_steps = std::atoi(argv[2]);
+    else if (argv[1][1] == 'i') sp.niter = std::atoi(argv[2]);
+    else if (argv[1][1] == 's') sp.stopthresh = std::atof(argv[2]);
+    else error_msg("Unknown option %s\n", argv[1]);
+  }
+  int argn = 2 + N_DIMS + 2;
+  if (argc-1 != argn)
+    error_msg("This program requires %i arguments!\n" \
+      "./balance_sim [-n <steps>] [-i <niter>] [-s <stopthresh>]  <dump|data-file>  <grid>  <nx> <ny> <nz>  <min-dist>  <runs>\n" \
+      "  -n:             number of rebalancing steps (default: 20)\n" \
+      "  -i:             bisection iterations per cut and step (Niter of balance shift, default: 5)\n" \
+      "  -s:             stopthresh: cut vectors (tiled: nodes) balanced below max/avg are not shifted (default: 1.0)\n" \
+      "  grid:           tensor, staggered or tiled (string)\n" \
+      "  min-dist:       minimal distance of the random initial cuts (as random_cuts)\n" \
+      "  runs:           <first-seed>:<n-seeds> (initial cuts of random_cuts with these seeds)\n" \
+      "                  or @<file> with one cut set per line (e.g. the output of random_cuts --batch <n> csv)\n",
+      argn);
+  if (n_steps < 0 || sp.niter < 0 || sp.stopthresh < 1.0) error_msg("invalid option values\n");
+
+  // parse arguments
+  std::vector<std::string> args = toStrVec(argc-1, argv+1);
+  GridStyle grid;
+  if (args[1] == "tensor")         grid = GridStyle::Tensor;
+  else if (args[1] == "staggered") grid = GridStyle::Staggered;
+  else if (args[1] == "tiled")     grid = GridStyle::Tiled;
+  else  error_msg("Unknown grid style %s\n", args[1].data());
+  int dims[3];
+  double min_dist = std::atof(argv[6]);
+  for (int comp = 0; comp < N_DIMS; ++comp) {
+    dims[comp] = std::atoi(argv[comp+3]);
+    if (dims[comp] < 1) error_msg("The number of regions has to be positive in every dimension\n");
+    if (1.0 / dims[comp] <= min_dist) error_msg("Minimal distance is too large\n");
+  }
+  uint32_t d = static_cast<uint32_t>(min_dist * UNITS + 0.5);
+
+  std::vector<std::vector<double>> initial;
+  if (args[6][0] == '@') {
+    std::ifstream cut_file(args[6].substr(1));
+    if (not cut_file) error_msg("unable to open %s\n", args[6].data() + 1);
+    for (std::string cut_csv; std::getline(cut_file, cut_csv);)
+      if (not cut_csv.empty()) initial.push_back(parse_csv(cut_csv));
+  } else {
+    size_t colon = args[6].find(':');
+    if (colon == std::string::npos) error_msg("invalid runs: %s\n", args[6].data());
+    uint64_t first_seed = std::stoull(args[6].substr(0, colon));
+    long n_seeds = std::atol(args[6].data() + colon + 1);
+    UnitCuts cuts{grid, {dims[0], dims[1], dims[2]}, d};
+    for (long seed = 0; seed < n_seeds; ++seed) {
+      cuts.generate(first_seed + seed, false);
+      initial.push_back(cuts.params());
+    }
+  }
+  for (const std::vector<double>& params : initial) {
+    if (params.size() != Cuts::n_params(dims[0], dims[1], dims[2], grid))
+      error_msg("The number of cuts does not fit the grid and processor dimensions\n");
+    if (grid == GridStyle::Tiled)
+      for (size_t i = 0; i < params.size(); i += 2)
+        if (params[i] != 0.0 && params[i] != 1.0 && params[i] != 2.0) error_msg("invalid cut dimension %g (0, 1 or 2)\n", params[i]);
+  }
+  if (initial.empty()) error_msg("no runs\n");
+
+  Atoms atoms = load_atoms(args[0].data());
+  if (atoms.n == 0) error_msg("no atoms in %s\n", args[0].data());
+
+  // runs in parallel, each one serial
+  size_t n_runs = initial.size();
+  std::vector<double> imbalances(n_runs * (n_steps + 1));
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t run = 0; run < n_runs; ++run) {
+    double* res = &imbalances[run * (n_steps + 1)];
+    if (grid == GridStyle::Tensor)         simulate(TensorRun(atoms, dims, initial[run]), atoms.n, n_steps, sp, res);
+    else if (grid == GridStyle::Staggered) simulate(StaggeredRun(atoms, dims, initial[run]), atoms.n, n_steps, sp, res);
+    else                                   simulate(TiledRun(atoms, dims, initial[run]), atoms.n, n_steps, sp, res);
+  }
+
+  std::printf("# runs %zu, atoms %zu, niter %i, stopthresh %g\n", n_runs, atoms.n, sp.niter, sp.stopthresh);
+  std::printf("# step  imbalance (max/avg) over the runs: mean min median max\n");
+  std::vector<double> values(n_runs);
+  for (int step = 0; step <= n_steps; ++step) {
+    for (size_t run = 0; run < n_runs; ++run) values[run] = imbalances[run * (n_steps + 1) + step];
+    std::sort(values.begin(), values.end());
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / n_runs;
+    double median = (n_runs % 2) ? values[n_runs / 2] : 0.5 * (values[n_runs / 2 - 1] + values[n_runs / 2]);
+    std::printf("%i %.6f %.6f %.6f %.6f\n", step, mean, values.front(), median, values.back());
+  }
+
+  return 0;
+}
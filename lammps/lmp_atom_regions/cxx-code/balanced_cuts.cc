@@ -0,0 +1,287 @@
+/*
+ *  balanced initial cuts from a particle distribution (instead of random_cuts or equidistant cuts): equal-weight
+ *  cuts from prefix-sum histograms, per dimension (tensor), per z-slab and y-column (staggered) or by recursive
+ *  weighted bisection (tiled/RCB), with the minimal distance of random_cuts and in its output formats
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include "utils.h"
+#include "grids.h"
+#include "positions.h"
+
+// atoms (weight 1) or the bin centers of a density histogram, coordinates scaled to [0, 1]
+struct WeightedPoints {
+  std::vector<double> xyz;
+  std::vector<double> weights;   // empty: all 1
+  Triple<double> lens{1.0, 1.0, 1.0};
+
+  size_t size() const { return xyz.size() / 3; }
+  double weight(size_t i) const { return weights.empty() ? 1.0 : weights[i]; }
+  double coord(size_t i, int dim) const { return xyz[3*i + dim]; }
+};
+
+WeightedPoints points_from_positions(const char* fname) {
+  Positions pos = read_positions(fname);
+  WeightedPoints pts;
+  pts.lens = pos.lens;
+  pts.xyz = std::move(pos.xyz);
+  const double lens[3] = {pts.lens.x, pts.lens.y, pts.lens.z};
+  #pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < pts.size(); ++i)
+    for (int dim = 0; dim < N_DIMS; ++dim) pts.xyz[3*i + dim] = std::clamp(pts.xyz[3*i + dim] / lens[dim], 0.0, 1.0);
+  return pts;
+}
+
+// histogram file: "<bins-x> <bins-y> <bins-z>", then the weights of the bins of the unit box in order z, y, x
+WeightedPoints points_from_histogram(const char* fname) {
+  std::ifstream file(fname);
+  if (not file) error_msg("unable to open %s\n", fname);
+  int bins[3];
+  if (not (file >> bins[0] >> bins[1] >> bins[2]) || bins[0] < 1 || bins[1] < 1 || bins[2] < 1)
+    error_msg("invalid histogram dimensions in %s\n", fname);
+  WeightedPoints pts;
+  for (int z = 0; z < bins[2]; ++z)
+    for (int y = 0; y < bins[1]; ++y)
+      for (int x = 0; x < bins[0]; ++x) {
+        double w;
+        if (not (file >> w)) error_msg("expected %i weights in %s\n", bins[0] * bins[1] * bins[2], fname);
+        if (w <= 0) continue;
+        pts.xyz.insert(pts.xyz.end(), {(x + 0.5) / bins[0], (y + 0.5) / bins[1], (z + 0.5) / bins[2]});
+        pts.weights.push_back(w);
+      }
+  return pts;
+}
+
+
+// prefix-sum histogram of the values of points in [lo, hi]
+struct Histogram {
+  double lo, hi;
+  std::vector<double> prefix;   // len: bins+1
+
+  Histogram(double lo, double hi, size_t bins) : lo{lo}, hi{hi}, prefix(bins + 1, 0.0) { }
+  size_t bins() const { return prefix.size() - 1; }
+  size_t bin(double val) const {
+    if (hi <= lo) return 0;
+    return std::min(bins() - 1, static_cast<size_t>(std::max(0.0, (val - lo) / (hi - lo) * bins())));
+  }
+  void add(double val, double w) { prefix[bin(val) + 1] += w; }
+  void finish() { std::partial_sum(prefix.begin(), prefix.end(), prefix.begin()); }
+  double total() const { return prefix.back(); }
+
+  // position with the fraction frac of the weight below (bisection of the prefix sums, linear within the bin)
+  double quantile(double frac) const {
+    double target = frac * total();
+    if (total() <= 0) return lo + frac * (hi - lo);
+    size_t b = std::lower_bound(prefix.begin() + 1, prefix.end(), target) - (prefix.begin() + 1);
+    b = std::min(b, bins() - 1);
+    double in_bin = prefix[b+1] - prefix[b];
+    double offset = (in_bin > 0) ? (target - prefix[b]) / in_bin : 0.5;
+    return lo + (b + offset) * (hi - lo) / bins();
+  }
+};
+
+// n-1 inner cuts (units) of the equal-weight quantiles of hist, projected onto the cuts with distances >= d
+// (incl. to 0 and 1): with u_i = cut_i - (i+1)*d the constraint is u sorted in [0, 1-n*d] -> isotonic
+// regression (pool adjacent violators), clamped and rounded
+std::vector<uint32_t> spaced_quantiles(const Histogram& hist, int n, uint32_t d) {
+  std::vector<double> u(n - 1);
+  for (int i = 0; i < n - 1; ++i) u[i] = hist.quantile(static_cast<double>(i + 1) / n) * UNITS - static_cast<double>(i + 1) * d;
+  std::vector<double> block_val;
+  std::vector<int> block_len;
+  for (double val : u) {
+    block_val.push_back(val);
+    block_len.push_back(1);
+    while (block_val.size() > 1 && block_val[block_val.size()-2] > block_val.back()) {
+      size_t last = block_val.size() - 1;
+      double merged = (block_val[last-1] * block_len[last-1] + block_val[last] * block_len[last]) / (block_len[last-1] + block_len[last]);
+      block_len[last-1] += block_len[last];
+      block_val[last-1] = merged;
+      block_val.pop_back();
+      block_len.pop_back();
+    }
+  }
+  double range = UNITS - static_cast<double>(n) * d;
+  std::vector<uint32_t> cuts;
+  for (size_t b = 0; b < block_val.size(); ++b)
+    for (int i = 0; i < block_len[b]; ++i) {
+      uint32_t val = static_cast<uint32_t>(std::lround(std::clamp(block_val[b], 0.0, range)));
+      cuts.push_back(val + (cuts.size() + 1) * d);
+    }
+  return cuts;
+}
+
+// thread-local histograms of values(i) in histogram hist_of(i) (or none: -1), merged
+template<class HistOf, class Value>
+void fill_histograms(std::vector<Histogram>& hists, const WeightedPoints& pts, HistOf hist_of, Value value) {
+  #pragma omp parallel
+  {
+    std::vector<Histogram> local = hists;
+    #pragma omp for schedule(static)
+    for (size_t i = 0; i < pts.size(); ++i) {
+      long h = hist_of(i);
+      if (h >= 0) local[h].add(value(i), pts.weight(i));
+    }
+    #pragma omp critical
+    for (size_t h = 0; h < hists.size(); ++h)
+      for (size_t b = 0; b < hists[h].prefix.size(); ++b) hists[h].prefix[b] += local[h].prefix[b];
+  }
+  for (Histogram& hist : hists) hist.finish();
+}
+
+
+// the cuts of UnitCuts (the layout and output of random_cuts) computed from the points
+struct Solver : UnitCuts {
+  size_t bins;
+
+  // interval of val (0-1) in the cut vector vec of dimension comp
+  int interval(int comp, size_t vec, double val) const {
+    const uint32_t* c = vector(comp, vec);
+    return std::upper_bound(c, c + dims[comp] - 1, static_cast<uint32_t>(val * UNITS)) - c;
+  }
+
+  // tensor: z, y and x vector from the marginal distributions
+  // staggered: z vector, the y vector of every slab from its atoms, the x vector of every column from its atoms
+  void solve_grid(const WeightedPoints& pts) {
+    cuts.assign(offset(-1), 0);
+    bool stag = (style == GridStyle::Staggered);
+    for (int comp = 2; comp >= 0; --comp) {
+      std::vector<Histogram> hists(n_vectors(comp), Histogram(0.0, 1.0, bins));
+      fill_histograms(hists, pts, [&](size_t i) -> long {
+        if (not stag || comp == 2) return 0;
+        int slab = interval(2, 0, pts.coord(i, 2));
+        if (comp == 1) return slab;
+        return static_cast<long>(slab) * dims[1] + interval(1, slab, pts.coord(i, 1));
+      }, [&](size_t i) { return pts.coord(i, comp); });
+      #pragma omp parallel for schedule(dynamic)
+      for (size_t vec = 0; vec < hists.size(); ++vec) {
+        std::vector<uint32_t> vec_cuts = spaced_quantiles(hists[vec], dims[comp], min_dist);
+        std::copy(vec_cuts.begin(), vec_cuts.end(), vector(comp, vec));
+      }
+    }
+  }
+
+  // recursive weighted bisection in the heap layout of RCBTree: node i splits the weight of its cell in the
+  // proportion of the regions below its children, along the longest side of the cell; the nodes of a level
+  // are independent (disjoint ranges of the point indices) and solved in parallel
+  void solve_tiled(const WeightedPoints& pts) {
+    size_t n_cuts = static_cast<size_t>(dims[0]) * dims[1] * dims[2] - 1;
+    cuts.assign(n_cuts, 0);
+    cutdims.assign(n_cuts, 0);
+    std::vector<size_t> leaves(2 * n_cuts + 1, 1);
+    for (size_t node = n_cuts; node-- > 0;) leaves[node] = leaves[2*node+1] + leaves[2*node+2];
+
+    std::vector<size_t> idx(pts.size());
+    std::iota(idx.begin(), idx.end(), 0);
+    std::vector<size_t> begin(2 * n_cuts + 1, 0), end(2 * n_cuts + 1, idx.size());
+    std::vector<Cell> cells(2 * n_cuts + 1, Cell{0.0, 1.0, 0.0, 1.0, 0.0, 1.0});
+    const double lens[3] = {pts.lens.x, pts.lens.y, pts.lens.z};
+
+    for (size_t first = 0; first < n_cuts; first = 2 * first + 1) {
+      size_t last = std::min(n_cuts, 2 * first + 1);
+      #pragma omp parallel for schedule(dynamic)
+      for (size_t node = first; node < last; ++node) {
+        Cell& cell = cells[node];
+        int dim = 0;
+        for (int d = 1; d < N_DIMS; ++d)
+          if ((cell.high(d) - cell.low(d)) * lens[d] > (cell.high(dim) - cell.low(dim)) * lens[dim]) dim = d;
+        Histogram hist(cell.low(dim), cell.high(dim), bins);
+        for (size_t i = begin[node]; i < end[node]; ++i) hist.add(pts.coord(idx[i], dim), pts.weight(idx[i]));
+        hist.finish();
+        double frac = static_cast<double>(leaves[2*node+1]) / leaves[node];
+        double ratio = (hist.quantile(frac) - cell.low(dim)) / (cell.high(dim) - cell.low(dim));
+        uint32_t ratio_units = std::clamp<long>(std::lround(ratio * UNITS), min_dist, UNITS - min_dist);
+        cuts[node] = ratio_units;
+        cutdims[node] = dim;
+
+        double pos = cell.low(dim) + (cell.high(dim) - cell.low(dim)) * (ratio_units / static_cast<double>(UNITS));
+        size_t mid = std::partition(idx.begin() + begin[node], idx.begin() + end[node],
+                                    [&](size_t i) { return pts.coord(i, dim) < pos; }) - idx.begin();
+        for (size_t kid : {2*node+1, 2*node+2}) cells[kid] = cell;
+        cells[2*node+1].high(dim) = pos;
+        cells[2*node+2].low(dim) = pos;
+        begin[2*node+1] = begin[node];
+        end[2*node+1] = mid;
+        begin[2*node+2] = mid;
+        end[2*node+2] = end[node];
+      }
+    }
+  }
+
+  void solve(const WeightedPoints& pts) {
+    if (style == GridStyle::Tiled) solve_tiled(pts);
+    else                           solve_grid(pts);
+  }
+};
+
+
+/**
+ *  interface: ./balanced_cuts [-b <bins>]  <mode>  <grid>  <nx> <ny> <nz>  <min-dist>  <dump|data-file|@histogram-file>
+ *    -b:               bins of the 1D histograms (default: 1024; staggered: one histogram per column)
+ *    mode:             csv or lmp-balance (string, as random_cuts)
+ *    grid:             tensor, staggered or tiled (string)
+ *    nx, ny, nz:       number of regions in direction x, y and z (int)
+ *    min-dist:         minimal distance of the cuts (relative, as random_cuts)
+ *    dump|data-file:   atom coordinates of a LAMMPS dump or data file (as balance_eval)
+ *    @histogram-file:  density histogram: "<bins-x> <bins-y> <bins-z>", then the weights in order z, y, x
+ */
+int main(int argc, char* argv[]) {
+  size_t bins = 1024;
+  if (argc > 2 && std::string(argv[1]) == "-b") {
+    bins = std::atol(argv[2]);
+    if (bins < 1) error_msg("The number of bins has to be positive\n");
+    argv += 2;
+    argc -= 2;
+  }
+  int argn = 2 + N_DIMS + 2;
+  if (argc-1 != argn)
+    error_msg("This program requires %i arguments!\n" \
+      "./balanced_cuts [-b <bins>]  <csv|lmp-balance>  <tensor|staggered|tiled>  <nx> <ny> <nz>  <min-dist>  <dump|data-file|@histogram-file>\n" \
+      "  -b:              bins of the 1D histograms (default: 1024; staggered: one histogram per column)\n" \
+      "  nx, ny, nz:      number of regions in direction x, y and z (int)\n" \
+      "  min-dist:        minimal distance of the cuts (relative, as random_cuts)\n" \
+      "  dump|data-file:  atom coordinates of a LAMMPS dump or data file\n" \
+      "  @histogram-file: density histogram: \"<bins-x> <bins-y> <bins-z>\", then the weights in order z, y, x\n",
+      argn);
+
+  // parse arguments
+  std::vector<std::string> args = toStrVec(argc-1, argv+1);
+  OutputMode mode;
+  Solver solver;
+  solver.bins = bins;
+  if (args[0] == "csv")              mode = OutputMode::Csv;
+  else if (args[0] == "lmp-balance") mode = OutputMode::LmpBalance;
+  else  error_msg("invalid output mode: %s\n", args[0].data());
+  if (args[1] == "tensor")         solver.style = GridStyle::Tensor;
+  else if (args[1] == "staggered") solver.style = GridStyle::Staggered;
+  else if (args[1] == "tiled")     solver.style = GridStyle::Tiled;
+  else  error_msg("Unknown grid style %s\n", args[1].data());
+  if (mode == OutputMode::LmpBalance && solver.style != GridStyle::Tensor)
+    error_msg("The `lmp-balance` output mode only works for tensor grid\n");
+  double min_dist = std::atof(argv[6]);
+  for (int comp = 0; comp < N_DIMS; ++comp) {
+    solver.dims[comp] = std::atoi(argv[comp+3]);
+    if (solver.dims[comp] < 1) error_msg("Only 3D grids are supported! (minimal dims: 1x1x1)\n");
+    if (1.0 / solver.dims[comp] <= min_dist) error_msg("Minimal distance is too large\n");
+  }
+  if (solver.style == GridStyle::Tiled && min_dist >= 0.5) error_msg("Minimal distance is too large\n");
+  solver.min_dist = static_cast<uint32_t>(min_dist * UNITS + 0.5);
+
+  WeightedPoints pts = (args[6][0] == '@') ? points_from_histogram(args[6].data() + 1) : points_from_positions(args[6].data());
+  solver.solve(pts);
+
+  std::string out;
+  if (mode == OutputMode::Csv) append_csv(out, solver);
+  else                         append_lmp_balance(out, solver);
+  out += '\n';
+  std::fwrite(out.data(), 1, out.size(), stdout);
+
+  return 0;
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include "utils.h"
+
+constexpr int N_DIMS = 3;
+
+
+enum class GridStyle {
+  Tensor,
+  Staggered,
+  Tiled
+};
+
+template<class T>
+struct Triple {
+  T x, y, z;
+  Triple() : x(0), y(0), z(0) { }
+  Triple(T x, T y, T z) : x{x}, y{y}, z{z} { }
+  T sum() const { return x + y + z; }
+  T prod() const { return x * y * z; }
+};
+
+struct Cell {
+  //double borders[2*N_DIMS];
+  double x_low, x_high;
+  double y_low, y_high;
+  double z_low, z_high;
+  // dim: 0 (x), 1 (y), 2 (z)
+  double& low(int dim)  { return (dim == 0) ? x_low  : (dim == 1) ? y_low  : z_low; }
+  double& high(int dim) { return (dim == 0) ? x_high : (dim == 1) ? y_high : z_high; }
+};
+
+
+// point location: region indices of n points (xyz: x, y, z of every point); points on a cut belong to the
+// upper region, points outside of the system to the nearest border region
+
+struct Cuts {
+  // interface: x, y, z
+  // internal:  z, y, x
+  Triple<int> dim;
+  GridStyle grid;
+  bool zero_one_scale;
+  std::vector<double> z_cuts;
+  std::vector<double> y_cuts;
+  std::vector<double> x_cuts;
+  Cuts(int x, int y, int z, GridStyle grid) : dim(x, y, z), grid{grid}, zero_one_scale{true} {
+    if (grid == GridStyle::Tensor) {
+      z_cuts = std::vector<double>(z+1, 0);
+      y_cuts = std::vector<double>(y+1, 0);
+      x_cuts = std::vector<double>(x+1, 0);
+    } else if (grid == GridStyle::Staggered) {
+      z_cuts = std::vector<double>(z+1, 0);
+      y_cuts = std::vector<double>(z * (y+1), 0);
+      x_cuts = std::vector<double>(z * y * (x+1), 0);
+    }
+  }
+
+  Cuts(int x, int y, int z, GridStyle grid, const std::vector<double>& zyx_cut_params, bool zero_one_scale = true) : Cuts(x, y, z, grid) {
+    this->zero_one_scale = zero_one_scale;
+    assert(z_cuts.size() + y_cuts.size() + x_cuts.size() == zyx_cut_params.size());
+    auto params = zyx_cut_params.begin();
+    std::copy(params, params + z_cuts.size(), z_cuts.begin());
+    params += z_cuts.size();
+    std::copy(params, params + y_cuts.size(), y_cuts.begin());
+    params += y_cuts.size();
+    std::copy(params, params + x_cuts.size(), x_cuts.begin());
+  }
+
+  // number of cut parameters of a grid (tensor/staggered: incl. 0 and 1 of every cut vector; tiled: dim,ratio pairs)
+  static size_t n_params(int x, int y, int z, GridStyle grid) {
+    if (grid == GridStyle::Tensor) return (z+1) + (y+1) + (x+1);
+    if (grid == GridStyle::Tiled)  return 2 * (static_cast<size_t>(x) * y * z - 1);
+    return (z+1) + static_cast<size_t>(z) * (y+1) + static_cast<size_t>(z) * y * (x+1);
+  }
+
+  Cuts operator*(const Triple<double>& lens) const {
+    if (not zero_one_scale)
+      error_msg("The Cuts are not on a 0-1 scale and can't be rescaled anymore!");
+    Cuts res(*this);
+    for (double& val : res.z_cuts) val *= lens.z;
+    for (double& val : res.y_cuts) val *= lens.y;
+    for (double& val : res.x_cuts) val *= lens.x;
+    res.zero_one_scale = false;
+    return res;
+  }
+
+  friend std::vector<double> complete_zero_one_scale(std::vector<double> zyx_cut_params, GridStyle grid) {
+    // TODO: make a minimalistic cut-list complete
+    //      otherwise only accept already complete cut lists
+    return zyx_cut_params;
+  }
+
+  // index of the interval of the cut vector cuts (len: n+1) containing val (binary search over the inner cuts)
+  static int interval(const double* cuts, int n, double val) {
+    return std::upper_bound(cuts + 1, cuts + n, val) - (cuts + 1);
+  }
+
+  // tensor/staggered (z, y, x order as System::coord_to_idx)
+  int32_t locate(double x, double y, double z) const {
+    int cz = interval(z_cuts.data(), dim.z, z);
+    if (grid == GridStyle::Tensor) {
+      int cy = interval(y_cuts.data(), dim.y, y);
+      int cx = interval(x_cuts.data(), dim.x, x);
+      return (cz * dim.y + cy) * dim.x + cx;
+    }
+    int cy = interval(y_cuts.data() + static_cast<size_t>(cz) * (dim.y+1), dim.y, y);
+    size_t column = static_cast<size_t>(cz) * dim.y + cy;
+    int cx = interval(x_cuts.data() + column * (dim.x+1), dim.x, x);
+    return column * dim.x + cx;
+  }
+
+  void locate(const double* xyz, size_t n, int32_t* regions) const {
+    for (size_t i = 0; i < n; ++i) regions[i] = locate(xyz[3*i], xyz[3*i+1], xyz[3*i+2]);
+  }
+};
+
+
+// RCB cut tree of a tiled grid as implicit array (heap layout, as asRCBCutTree of the Nim version builds it):
+// node i (< n_cuts) has the children 2i+1 and 2i+2, indices >= n_cuts are the regions (slots)
+// the extended tree (nodes + slots, len: 2*n_cuts+1) is complete, so the regions in depth-first order
+// (the region numbering of calc_regionborders) are the slots of its last level followed by the ones above
+struct RCBTree {
+  size_t n_cuts = 0;
+  int depth = 0;                  // level of the last level of the extended tree
+  size_t first_last = 0;          // first slot of the last level
+  std::vector<uint8_t> cutdims;   // len: 2*n_cuts+1 (slots padded, so a traversal step needs no branch)
+  std::vector<double> cutpos;     // absolute position of the cut
+  std::vector<Cell> cells;        // len: n_cuts+1 (by region)
+
+  RCBTree() = default;
+
+  // cuts: pairs of dim (0: x, 1: y, 2: z) and ratio of the cut within the cell of the node
+  RCBTree(const std::vector<double>& dim_ratio_params, const Triple<double>& lens) : n_cuts{dim_ratio_params.size() / 2} {
+    size_t len = 2 * n_cuts + 1;
+    while ((size_t(2) << depth) <= len) ++depth;
+    first_last = (size_t(1) << depth) - 1;
+    cutdims.assign(len, 0);
+    cutpos.assign(len, 0.0);
+    cells.resize(n_cuts + 1);
+
+    // one pass in heap order: the cell of a node is known before its cut splits it for the children
+    std::vector<Cell> node_cells(len);
+    node_cells[0] = Cell{0.0, lens.x, 0.0, lens.y, 0.0, lens.z};
+    for (size_t node = 0; node < n_cuts; ++node) {
+      int dim = static_cast<int>(dim_ratio_params[2*node]);
+      if (dim < 0 || dim >= N_DIMS) error_msg("invalid cut dimension %i\n", dim);
+      Cell& cell = node_cells[node];
+      double pos = cell.low(dim) + (cell.high(dim) - cell.low(dim)) * dim_ratio_params[2*node+1];
+      cutdims[node] = dim;
+      cutpos[node] = pos;
+      node_cells[2*node+1] = cell;
+      node_cells[2*node+1].high(dim) = pos;
+      node_cells[2*node+2] = cell;
+      node_cells[2*node+2].low(dim) = pos;
+    }
+    for (size_t slot = n_cuts; slot < len; ++slot) cells[slot_to_region(slot)] = node_cells[slot];
+  }
+
+  size_t n_regions() const { return n_cuts + 1; }
+
+  int32_t slot_to_region(size_t slot) const {
+    return (slot >= first_last) ? slot - first_last : slot - n_cuts + (2 * n_cuts + 1 - first_last);
+  }
+
+  const Cell& cell(size_t reg) const { return cells[reg]; }
+
+  // all levels above the last one are complete -> depth-1 unconditional steps, the last step only for nodes
+  // of the second to last level; a block of points walks the tree level by level (vectorizable inner loop)
+  void locate(const double* xyz, size_t n, int32_t* regions) const {
+    constexpr size_t BLOCK = 64;
+    const uint8_t* dims = cutdims.data();
+    const double* pos = cutpos.data();
+    uint32_t nodes[BLOCK];
+    for (size_t first = 0; first < n; first += BLOCK) {
+      size_t len = std::min(BLOCK, n - first);
+      const double* p = xyz + 3 * first;
+      std::fill(nodes, nodes + len, 0);
+      for (int level = 1; level < depth; ++level)
+        for (size_t i = 0; i < len; ++i)
+          nodes[i] = 2 * nodes[i] + 1 + (p[3*i + dims[nodes[i]]] >= pos[nodes[i]]);
+      if (depth > 0)
+        for (size_t i = 0; i < len; ++i) {
+          uint32_t next = 2 * nodes[i] + 1 + (p[3*i + dims[nodes[i]]] >= pos[nodes[i]]);
+          nodes[i] = (nodes[i] < n_cuts) ? next : nodes[i];
+        }
+      for (size_t i = 0; i < len; ++i) regions[first + i] = slot_to_region(nodes[i]);
+    }
+  }
+
+  int32_t locate(double x, double y, double z) const {
+    double p[3] = {x, y, z};
+    int32_t reg;
+    locate(p, 1, &reg);
+    return reg;
+  }
+};
+
+
+// cut sets in integer units of 1e-6 (as the cuts of the Nim version, which are rounded to 6 digits), as random_cuts
+// generates them and balanced_cuts computes them, with their output formats
+constexpr uint32_t UNITS = 1000000;
+
+enum class OutputMode { Csv, LmpBalance };
+
+// n-1 sorted cuts in [d, 1-d] with distances >= d, uniformly distributed over all such sets (no rejection):
+// the gaps are removed (cut i shifted by -(i+1)*d), so the cuts are n-1 sorted uniform samples in [0, 1-n*d]
+inline void spaced_cuts(CounterRng rng, int n, uint32_t d, uint32_t* cuts) {
+  uint32_t range = UNITS - n * d;
+  for (int i = 0; i < n - 1; ++i) cuts[i] = rng.below(range + 1);
+  std::sort(cuts, cuts + n - 1);
+  for (int i = 0; i < n - 1; ++i) cuts[i] += (i + 1) * d;
+}
+
+struct UnitCuts {
+  GridStyle style;
+  int dims[3];   // x, y, z
+  uint32_t min_dist;
+  std::vector<uint32_t> cuts;   // tensor/staggered: z vectors, y vectors, x vectors (interior cuts); tiled: ratios
+  std::vector<uint8_t> cutdims; // tiled: dimension of each cut (0: x, 1: y, 2: z)
+
+  // number of cut vectors of dimension comp (staggered: one per plane/column)
+  size_t n_vectors(int comp) const {
+    if (style == GridStyle::Tensor or comp == 2) return 1;
+    return (comp == 1) ? dims[2] : static_cast<size_t>(dims[2]) * dims[1];
+  }
+  size_t offset(int comp) const {   // order: z, y, x
+    size_t off = 0;
+    for (int c = 2; c > comp; --c) off += n_vectors(c) * (dims[c] - 1);
+    return off;
+  }
+  // interior cuts of the cut vector vec of dimension comp (len: dims[comp]-1, may be 0)
+  uint32_t* vector(int comp, size_t vec) { return cuts.data() + offset(comp) + vec * (dims[comp] - 1); }
+  const uint32_t* vector(int comp, size_t vec) const { return cuts.data() + offset(comp) + vec * (dims[comp] - 1); }
+
+  // random cuts: every cut vector (tiled: every cut) has its own stream of the seed
+  void generate(uint64_t seed, bool parallel) {
+    if (style == GridStyle::Tiled) {
+      long n = static_cast<long>(dims[0]) * dims[1] * dims[2] - 1;
+      cuts.resize(n);
+      cutdims.resize(n);
+      #pragma omp parallel for schedule(static) if(parallel)
+      for (long i = 0; i < n; ++i) {
+        CounterRng rng(seed, i);
+        cutdims[i] = rng.below(3);
+        cuts[i] = min_dist + rng.below(UNITS - 2 * min_dist + 1);
+      }
+      return;
+    }
+    cuts.resize(offset(-1));
+    long n_vec = n_vectors(2) + n_vectors(1) + n_vectors(0);
+    #pragma omp parallel for schedule(dynamic, 256) if(parallel)
+    for (long vec = 0; vec < n_vec; ++vec) {
+      int comp = 2;
+      long idx = vec;
+      for (; idx >= static_cast<long>(n_vectors(comp)); --comp) idx -= n_vectors(comp);
+      spaced_cuts(CounterRng(seed, vec), dims[comp], min_dist, vector(comp, idx));
+    }
+  }
+
+  // cut parameters as atom_regions reads them (the values of append_csv)
+  std::vector<double> params() const {
+    std::vector<double> res;
+    if (style == GridStyle::Tiled) {
+      for (size_t i = 0; i < cuts.size(); ++i) {
+        res.push_back(cutdims[i]);
+        res.push_back(cuts[i] / static_cast<double>(UNITS));
+      }
+      return res;
+    }
+    for (int comp = 2; comp >= 0; --comp)
+      for (size_t vec = 0; vec < n_vectors(comp); ++vec) {
+        res.push_back(0.0);
+        for (int i = 0; i < dims[comp] - 1; ++i) res.push_back(vector(comp, vec)[i] / static_cast<double>(UNITS));
+        res.push_back(1.0);
+      }
+    return res;
+  }
+};
+
+// shortest representation of units/1e6 (always with a '.' as Nim's $ of a float)
+inline void append_cut(std::string& out, uint32_t units) {
+  char buf[32];
+  char* end = std::to_chars(buf, buf + sizeof(buf), units / static_cast<double>(UNITS)).ptr;
+  if (not std::memchr(buf, '.', end - buf)) { *end++ = '.'; *end++ = '0'; }
+  out.append(buf, end);
+}
+
+// csv: z, y, x cut vectors including 0 and 1 (tiled: dim,ratio pairs)
+inline void append_csv(std::string& out, const UnitCuts& grid) {
+  if (grid.style == GridStyle::Tiled) {
+    for (size_t i = 0; i < grid.cuts.size(); ++i) {
+      if (i) out += ',';
+      out += static_cast<char>('0' + grid.cutdims[i]);
+      out += ',';
+      append_cut(out, grid.cuts[i]);
+    }
+    return;
+  }
+  bool first = true;
+  for (int comp = 2; comp >= 0; --comp)
+    for (size_t vec = 0; vec < grid.n_vectors(comp); ++vec) {
+      const uint32_t* cuts = grid.vector(comp, vec);
+      out += first ? "0.0," : ",0.0,";
+      first = false;
+      for (int i = 0; i < grid.dims[comp] - 1; ++i) { append_cut(out, cuts[i]); out += ','; }
+      out += "1.0";
+    }
+}
+
+// LAMMPS command for the tensor grid: "balance 0.9  x <cuts> y <cuts> z <cuts>"
+inline void append_lmp_balance(std::string& out, const UnitCuts& grid) {
+  if (grid.dims[0] + grid.dims[1] + grid.dims[2] == 3) return;
+  out += "balance 0.9 ";
+  const char* names[3] = {" x", " y", " z"};
+  for (int comp = 0; comp < 3; ++comp) {
+    if (grid.dims[comp] == 1) continue;
+    out += names[comp];
+    const uint32_t* cuts = grid.vector(comp, 0);
+    for (int i = 0; i < grid.dims[comp] - 1; ++i) { out += ' '; append_cut(out, cuts[i]); }
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include "utils.h"
+#include "grids.h"
+
+// numbering of the regions of tensor/staggered grids (region names, atom seeds and so the rank mapping):
+// row-major z-y-x (coord_to_idx), or along a Morton (Z-order) or Hilbert curve through the coordinates
+enum class RegionOrder {
+  RowMajor,
+  Morton,
+  Hilbert
+};
+
+// the lower 21 bits of v to every third bit
+inline uint64_t spread_bits3(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffull;
+  v = (v | v << 16) & 0x1f0000ff0000ffull;
+  v = (v | v << 8)  & 0x100f00f00f00f00full;
+  v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+  v = (v | v << 2)  & 0x1249249249249249ull;
+  return v;
+}
+
+// z as most significant dimension (as the row-major order)
+inline uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z) {
+  return spread_bits3(z) << 2 | spread_bits3(y) << 1 | spread_bits3(x);
+}
+
+// Hilbert index in a cube of 2^bits (Skilling, "Programming the Hilbert curve", 2004): the coordinates are
+// transformed in place to the "transposed" index, whose interleaved bits are the index
+inline uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z, int bits) {
+  uint32_t X[3] = {z, y, x};
+  if (bits == 0) return 0;
+  for (uint32_t Q = 1u << (bits - 1); Q > 1; Q >>= 1) {
+    uint32_t P = Q - 1;
+    for (int i = 0; i < 3; ++i) {
+      if (X[i] & Q) {
+        X[0] ^= P;
+      } else {
+        uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  uint32_t t = 0;
+  for (uint32_t Q = 1u << (bits - 1); Q > 1; Q >>= 1)
+    if (X[2] & Q) t ^= Q - 1;
+  for (uint32_t& v : X) v ^= t;
+  return spread_bits3(X[0]) << 2 | spread_bits3(X[1]) << 1 | spread_bits3(X[2]);
+}
+
+// row-major indices of the regions in the order (empty for RowMajor); grids that are no cube of a power of two
+// are ordered by the keys of their coordinates in the enclosing cube (the curve skips the missing coordinates)
+inline std::vector<int32_t> region_order(const Triple<int>& procs, RegionOrder order) {
+  if (order == RegionOrder::RowMajor) return {};
+  int bits = 0;
+  while ((1 << bits) < std::max({procs.x, procs.y, procs.z})) ++bits;
+  long n = static_cast<long>(procs.x) * procs.y * procs.z;
+  std::vector<uint64_t> keys(n);
+  #pragma omp parallel for schedule(static)
+  for (long idx = 0; idx < n; ++idx) {
+    uint32_t x = idx % procs.x, y = (idx / procs.x) % procs.y, z = idx / (static_cast<long>(procs.x) * procs.y);
+    keys[idx] = (order == RegionOrder::Morton) ? morton_key(x, y, z) : hilbert_key(x, y, z, bits);
+  }
+  std::vector<int32_t> res(n);
+  std::iota(res.begin(), res.end(), 0);
+  std::sort(res.begin(), res.end(), [&keys](int32_t a, int32_t b) { return keys[a] < keys[b]; });
+  return res;
+}
+
+inline RegionOrder parse_region_order(const std::string& name) {
+  if (name == "row-major") return RegionOrder::RowMajor;
+  if (name == "morton")    return RegionOrder::Morton;
+  if (name == "hilbert")   return RegionOrder::Hilbert;
+  error_msg("Unknown region order %s\n", name.data());
+  return RegionOrder::RowMajor;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utils.h"
+#include "grids.h"
+
+// read-only mapping of a whole file
+struct MappedFile {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  MappedFile(const char* fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) error_msg("unable to open %s\n", fname);
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if (size) {
+      void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) error_msg("unable to mmap %s\n", fname);
+      madvise(ptr, size, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(ptr);
+    }
+    close(fd);
+  }
+  ~MappedFile() { if (data) munmap(const_cast<char*>(data), size); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+
+// atom coordinates relative to the lower box corner (as the cuts, which start at 0)
+struct Positions {
+  Triple<double> lo, lens;
+  std::vector<double> xyz;   // x, y, z of every atom
+
+  size_t size() const { return xyz.size() / 3; }
+};
+
+namespace positions_detail {
+
+inline const char* skip_space(const char* pos, const char* end) {
+  while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) ++pos;
+  return pos;
+}
+inline const char* skip_field(const char* pos, const char* end) {
+  pos = skip_space(pos, end);
+  while (pos < end && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n') ++pos;
+  return pos;
+}
+inline const char* next_line(const char* pos, const char* end) {
+  const char* nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+  return nl ? nl + 1 : end;
+}
+inline std::string_view line_at(const char* pos, const char* end) {
+  const char* nl = next_line(pos, end);
+  return std::string_view(pos, nl - pos - (nl > pos && nl[-1] == '\n'));
+}
+inline double parse_double(const char*& pos, const char* end) {
+  pos = skip_space(pos, end);
+  double val;
+  auto res = std::from_chars(pos, end, val);
+  if (res.ec != std::errc()) error_msg("invalid number: %.40s\n", std::string(line_at(pos, end)).data());
+  pos = res.ptr;
+  return val;
+}
+
+// n_atoms lines starting at begin, coordinates in the columns cols (x, y, z), shifted by -lo (scaled: multiplied
+// by lens); chunks of the file are parsed in parallel: first their number of lines, then the lines into place
+inline void parse_atom_lines(const char* begin, const char* end, size_t n_atoms, const int cols[3], bool scaled, Positions& pos) {
+  pos.xyz.resize(3 * n_atoms);
+  size_t n_chunks = 1 + (end - begin) / (1 << 24);
+  std::vector<const char*> starts(n_chunks + 1, end);
+  std::vector<size_t> first_line(n_chunks + 1, 0);
+  starts[0] = begin;
+  for (size_t chunk = 1; chunk < n_chunks; ++chunk)
+    starts[chunk] = next_line(begin + chunk * ((end - begin) / n_chunks) - 1, end);
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    size_t n = 0;
+    for (const char* p = starts[chunk]; p < starts[chunk+1]; p = next_line(p, starts[chunk+1])) ++n;
+    first_line[chunk+1] = n;
+  }
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) first_line[chunk+1] += first_line[chunk];
+  if (first_line[n_chunks] < n_atoms) error_msg("expected %zu atoms, found %zu\n", n_atoms, first_line[n_chunks]);
+
+  const double lo[3] = {pos.lo.x, pos.lo.y, pos.lo.z}, lens[3] = {pos.lens.x, pos.lens.y, pos.lens.z};
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    size_t atom = first_line[chunk];
+    for (const char* p = starts[chunk]; p < starts[chunk+1] && atom < n_atoms; p = next_line(p, starts[chunk+1]), ++atom) {
+      double* out = &pos.xyz[3 * atom];
+      const char* field = p;
+      int col = 0;
+      for (int dim = 0; dim < N_DIMS; ++dim) {
+        for (; col < cols[dim]; ++col) field = skip_field(field, end);
+        out[dim] = parse_double(field, end);
+        ++col;
+        out[dim] = scaled ? out[dim] * lens[dim] : out[dim] - lo[dim];
+      }
+    }
+  }
+}
+
+// first snapshot of a dump (x y z, xu yu zu or xs ys zs columns, orthogonal box)
+inline void read_dump(const char* data, const char* end, Positions& pos) {
+  size_t n_atoms = 0;
+  const char* p = data;
+  while (p < end) {
+    std::string_view line = line_at(p, end);
+    p = next_line(p, end);
+    if (line.rfind("ITEM: NUMBER OF ATOMS", 0) == 0) {
+      n_atoms = std::strtoull(p, nullptr, 10);
+      p = next_line(p, end);
+    } else if (line.rfind("ITEM: BOX BOUNDS", 0) == 0) {
+      if (line.find("xy") != std::string_view::npos) error_msg("triclinic boxes are not supported\n");
+      double bounds[2*N_DIMS];
+      for (int dim = 0; dim < N_DIMS; ++dim, p = next_line(p, end)) {
+        bounds[2*dim]   = parse_double(p, end);
+        bounds[2*dim+1] = parse_double(p, end);
+      }
+      pos.lo = Triple<double>(bounds[0], bounds[2], bounds[4]);
+      pos.lens = Triple<double>(bounds[1] - bounds[0], bounds[3] - bounds[2], bounds[5] - bounds[4]);
+    } else if (line.rfind("ITEM: ATOMS", 0) == 0) {
+      std::vector<std::string> names;
+      for (const char* f = line.data() + 11; f < line.data() + line.size();) {
+        const char* start = skip_space(f, line.data() + line.size());
+        f = skip_field(f, line.data() + line.size());
+        if (f > start) names.emplace_back(start, f);
+      }
+      int cols[3] = {-1, -1, -1};
+      bool scaled = false;
+      const char* dims[3] = {"x", "y", "z"};
+      for (int dim = 0; dim < N_DIMS; ++dim)
+        for (size_t col = 0; col < names.size(); ++col)
+          if (names[col] == dims[dim] || names[col] == std::string(dims[dim]) + "u" ||
+              names[col] == std::string(dims[dim]) + "s" || names[col] == std::string(dims[dim]) + "su") {
+            cols[dim] = col;
+            scaled = names[col].find('s') != std::string::npos;
+          }
+      if (cols[0] < 0 || cols[1] < 0 || cols[2] < 0) error_msg("dump has no x y z columns\n");
+      if (cols[0] > cols[1] || cols[1] > cols[2]) error_msg("dump columns have to be ordered x, y, z\n");
+      parse_atom_lines(p, end, n_atoms, cols, scaled, pos);
+      return;
+    }
+  }
+  error_msg("dump without ITEM: ATOMS section\n");
+}
+
+// Atoms section of a data file (column of x from the atom style comment: "Atoms # <style>", default: atomic)
+inline void read_data(const char* data, const char* end, Positions& pos) {
+  size_t n_atoms = 0;
+  double bounds[2*N_DIMS] = {0.0};
+  const char* p = next_line(data, end);  // first line: title
+  while (p < end) {
+    std::string_view line = line_at(p, end);
+    const char* line_end = line.data() + line.size();
+    p = next_line(p, end);
+    std::string_view::size_type comment = line.find('#');
+    std::string_view content = line.substr(0, comment);
+    if (content.find(" atoms") != std::string_view::npos) {
+      n_atoms = std::strtoull(content.data(), nullptr, 10);
+    } else if (content.find("xlo xhi") != std::string_view::npos || content.find("ylo yhi") != std::string_view::npos ||
+               content.find("zlo zhi") != std::string_view::npos) {
+      int dim = content.find("xlo") != std::string_view::npos ? 0 : content.find("ylo") != std::string_view::npos ? 1 : 2;
+      const char* f = content.data();
+      bounds[2*dim] = parse_double(f, line_end);
+      bounds[2*dim+1] = parse_double(f, line_end);
+    } else if (content.find("xy xz yz") != std::string_view::npos) {
+      error_msg("triclinic boxes are not supported\n");
+    } else if (content.rfind("Atoms", 0) == 0) {
+      std::string style = (comment == std::string_view::npos) ? "atomic" : std::string(line.substr(comment + 1));
+      style.erase(0, style.find_first_not_of(" \t"));
+      style.erase(style.find_last_not_of(" \t\r") + 1);
+      int x_col = 2;                                                     // atomic: id type x y z
+      if (style == "charge" || style == "molecular" || style == "bond" || style == "angle") x_col = 3;
+      else if (style == "full" || style == "sphere")                                        x_col = 4;
+      else if (style != "atomic") error_msg("unsupported atom style: %s\n", style.data());
+      while (p < end && line_at(p, end).find_first_not_of(" \t\r") == std::string_view::npos) p = next_line(p, end);
+      pos.lo = Triple<double>(bounds[0], bounds[2], bounds[4]);
+      pos.lens = Triple<double>(bounds[1] - bounds[0], bounds[3] - bounds[2], bounds[5] - bounds[4]);
+      const int cols[3] = {x_col, x_col + 1, x_col + 2};
+      parse_atom_lines(p, end, n_atoms, cols, false, pos);
+      return;
+    }
+  }
+  error_msg("data file without Atoms section\n");
+}
+
+} // namespace positions_detail
+
+// LAMMPS dump (starts with "ITEM: TIMESTEP") or data file
+inline Positions read_positions(const char* fname) {
+  MappedFile file(fname);
+  Positions pos;
+  const char* end = file.data + file.size;
+  if (file.size >= 5 && std::strncmp(file.data, "ITEM:", 5) == 0) positions_detail::read_dump(file.data, end, pos);
+  else                                                             positions_detail::read_data(file.data, end, pos);
+  if (pos.lens.x <= 0 || pos.lens.y <= 0 || pos.lens.z <= 0) error_msg("invalid box bounds in %s\n", fname);
+  return pos;
+}
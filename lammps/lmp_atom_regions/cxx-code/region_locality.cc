@@ -0,0 +1,158 @@
+/*
+ *  locality of the region numberings (row-major, morton, hilbert) of a tensor or staggered grid: regions are
+ *  mapped to ranks by their number and to nodes by ranks-per-node, the face neighbors of different nodes are
+ *  the pairs whose halo exchange crosses the network
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstdio>
+#include "utils.h"
+#include "system.h"
+#include "ordering.h"
+
+using RegionPair = std::pair<int32_t, int32_t>;
+
+// pairs (i, j) of the intervals of the cut vectors a (len: na+1) and b (len: nb+1) that overlap (positive length)
+template<class Fn>
+void overlapping_intervals(const double* a, int na, const double* b, int nb, Fn fn) {
+  for (int i = 0, j = 0; i < na && j < nb;) {
+    if (std::min(a[i+1], b[j+1]) > std::max(a[i], b[j])) fn(i, j);
+    if (a[i+1] < b[j+1])      ++i;
+    else if (b[j+1] < a[i+1]) ++j;
+    else                      { ++i; ++j; }
+  }
+}
+
+// face neighbors (row-major indices): tensor grids by the coordinates, staggered grids by overlapping faces of
+// the neighboring columns (y) and slabs (z)
+std::vector<RegionPair> neighbor_pairs(const System& sys) {
+  const Triple<int>& p = sys.procs;
+  const Cuts& cuts = sys.cuts;
+  std::vector<RegionPair> pairs;
+  for (int z = 0; z < p.z; ++z)
+    for (int y = 0; y < p.y; ++y)
+      for (int x = 0; x + 1 < p.x; ++x)
+        pairs.emplace_back(sys.coord_to_idx({x, y, z}), sys.coord_to_idx({x + 1, y, z}));
+  if (cuts.grid == GridStyle::Tensor) {
+    for (int z = 0; z < p.z; ++z)
+      for (int y = 0; y < p.y; ++y)
+        for (int x = 0; x < p.x; ++x) {
+          if (y + 1 < p.y) pairs.emplace_back(sys.coord_to_idx({x, y, z}), sys.coord_to_idx({x, y + 1, z}));
+          if (z + 1 < p.z) pairs.emplace_back(sys.coord_to_idx({x, y, z}), sys.coord_to_idx({x, y, z + 1}));
+        }
+    return pairs;
+  }
+  auto y_vec = [&](int z) { return &cuts.y_cuts[static_cast<size_t>(z) * (p.y + 1)]; };
+  auto x_vec = [&](int z, int y) { return &cuts.x_cuts[(static_cast<size_t>(z) * p.y + y) * (p.x + 1)]; };
+  for (int z = 0; z < p.z; ++z)
+    for (int y = 0; y + 1 < p.y; ++y)
+      overlapping_intervals(x_vec(z, y), p.x, x_vec(z, y + 1), p.x, [&](int x0, int x1) {
+        pairs.emplace_back(sys.coord_to_idx({x0, y, z}), sys.coord_to_idx({x1, y + 1, z}));
+      });
+  for (int z = 0; z + 1 < p.z; ++z)
+    overlapping_intervals(y_vec(z), p.y, y_vec(z + 1), p.y, [&](int y0, int y1) {
+      overlapping_intervals(x_vec(z, y0), p.x, x_vec(z + 1, y1), p.x, [&](int x0, int x1) {
+        pairs.emplace_back(sys.coord_to_idx({x0, y0, z}), sys.coord_to_idx({x1, y1, z + 1}));
+      });
+    });
+  return pairs;
+}
+
+
+/**
+ *  interface: ./region_locality <ranks-per-node>  <grid>  <procs-x> <procs-y> <procs-z>  [<cut-parameters>]
+ *    ranks-per-node:             regions (ranks) per node, rank = region number
+ *    grid:                       tensor or staggered (string)
+ *    procs-x, procs-y, procs-z:  number of processors in direction x, y and z (int)
+ *    cut-parameters:             cuts as for atom_regions (csv or @<file>), default: equidistant
+ *                                (only the neighbors of staggered grids depend on the cuts)
+ *  output per numbering: pairs between nodes (fraction of all neighbor pairs), per node: halo pairs (pairs with
+ *  one region on the node) and neighbor nodes (avg max)
+ */
+int main(int argc, char* argv[]) {
+  int argn = 2 + N_DIMS;
+  if (argc-1 != argn && argc-1 != argn + 1)
+    error_msg("This program requires %i or %i arguments!\n" \
+      "./region_locality <ranks-per-node>  <grid>  <procs-x> <procs-y> <procs-z>  [<cut-params>]\n" \
+      "  ranks-per-node:            regions (ranks) per node, rank = region number\n" \
+      "  grid:                      tensor or staggered (string)\n" \
+      "  procs-x, procs-y, procs-z: number of processors in direction x, y and z (int)\n" \
+      "  cut-parameters:            cuts as for atom_regions (csv or @<file>), default: equidistant\n",
+      argn, argn + 1);
+
+  // parse arguments
+  std::vector<std::string> args = toStrVec(argc-1, argv+1);
+  long ranks_per_node = std::atol(argv[1]);
+  if (ranks_per_node < 1) error_msg("The number of ranks per node has to be positive\n");
+  int cnt = 1;
+  GridStyle grid;
+  if (args[cnt] == "tensor")         grid = GridStyle::Tensor;
+  else if (args[cnt] == "staggered") grid = GridStyle::Staggered;
+  else  error_msg("Unknown grid style %s (only tensor and staggered grids)\n", args[cnt].data());
+  ++cnt;
+
+  Triple<int> procs(std::atoi(argv[cnt+1]), std::atoi(argv[cnt+2]), std::atoi(argv[cnt+3]));
+  cnt += N_DIMS;
+  if (procs.x < 1 || procs.y < 1 || procs.z < 1) error_msg("The number of processors has to be positive in every dimension\n");
+
+  std::vector<double> cut_params;
+  if (cnt < static_cast<int>(args.size())) {
+    std::string cut_csv = args[cnt];
+    if (cut_csv[0] == '@') {
+      std::ifstream cut_file(cut_csv.substr(1));
+      if (not cut_file) error_msg("unable to open %s\n", cut_csv.data() + 1);
+      std::getline(cut_file, cut_csv);
+    }
+    cut_params = parse_csv(cut_csv);
+  } else {
+    auto equidistant = [&cut_params](int n, long times) {
+      for (long i = 0; i < times; ++i)
+        for (int c = 0; c <= n; ++c) cut_params.push_back(static_cast<double>(c) / n);
+    };
+    bool stag = (grid == GridStyle::Staggered);
+    equidistant(procs.z, 1);
+    equidistant(procs.y, stag ? procs.z : 1);
+    equidistant(procs.x, stag ? static_cast<long>(procs.z) * procs.y : 1);
+  }
+  System sys = System::make(grid, procs, Triple<double>(1.0, 1.0, 1.0), cut_params);
+
+  std::vector<RegionPair> pairs = neighbor_pairs(sys);
+  long n_nodes = (sys.n_regions() + ranks_per_node - 1) / ranks_per_node;
+  std::printf("# regions %ld, ranks-per-node %ld, nodes %ld, neighbor pairs %zu\n",
+              sys.n_regions(), ranks_per_node, n_nodes, pairs.size());
+  std::printf("# order      inter-node-pairs (fraction)   halo-pairs/node (avg max)   neighbor-nodes/node (avg max)\n");
+
+  const char* names[] = {"row-major", "morton", "hilbert"};
+  for (RegionOrder order : {RegionOrder::RowMajor, RegionOrder::Morton, RegionOrder::Hilbert}) {
+    sys.set_order(order);
+    auto node = [&](int32_t idx) { return (sys.rank_of.empty() ? idx : sys.rank_of[idx]) / ranks_per_node; };
+    std::vector<long> halo(n_nodes, 0);
+    std::vector<std::pair<long, long>> node_pairs;
+    long inter = 0;
+    for (const RegionPair& pair : pairs) {
+      long a = node(pair.first), b = node(pair.second);
+      if (a == b) continue;
+      ++inter;
+      ++halo[a];
+      ++halo[b];
+      node_pairs.emplace_back(std::min(a, b), std::max(a, b));
+    }
+    std::sort(node_pairs.begin(), node_pairs.end());
+    node_pairs.erase(std::unique(node_pairs.begin(), node_pairs.end()), node_pairs.end());
+    std::vector<long> neighbor_nodes(n_nodes, 0);
+    for (auto& np : node_pairs) { ++neighbor_nodes[np.first]; ++neighbor_nodes[np.second]; }
+
+    std::printf("%-10s  %10ld (%.4f)   %12.1f %8ld   %12.2f %8ld\n", names[static_cast<int>(order)], inter,
+                pairs.empty() ? 0.0 : static_cast<double>(inter) / pairs.size(),
+                2.0 * inter / n_nodes, *std::max_element(halo.begin(), halo.end()),
+                2.0 * node_pairs.size() / n_nodes, *std::max_element(neighbor_nodes.begin(), neighbor_nodes.end()));
+  }
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include "utils.h"
+#include "grids.h"
+#include "ordering.h"
+
+struct AtomParams {
+  long atoms_per_region;
+  long creation_seed;
+  bool inc_seed;
+};
+
+struct System {
+  Triple<int> procs;
+  Triple<double> lens;
+  Cuts cuts;
+  RCBTree tree;     // tiled grid
+  double region_gap;
+  std::vector<int32_t> order;     // region -> row-major index (empty: row-major numbering)
+  std::vector<int32_t> rank_of;   // row-major index -> region
+
+  // the cells of tensor/staggered grids are not stored (len: procs.prod() could be 10^6 and more),
+  // cell(reg) calculates them on the fly
+  System(Triple<int> procs, Triple<double> lens, Cuts cuts, double region_gap = 0)
+    : procs{procs}, lens{lens}, cuts{cuts}, region_gap{region_gap} {
+    // scale cuts
+    if (this->cuts.zero_one_scale) this->cuts = this->cuts * lens;
+  }
+
+  System(Triple<int> procs, Triple<double> lens, RCBTree tree, double region_gap = 0)
+    : procs{procs}, lens{lens}, cuts(procs.x, procs.y, procs.z, GridStyle::Tiled), tree{std::move(tree)}, region_gap{region_gap} { }
+
+  long n_regions() const { return static_cast<long>(procs.x) * procs.y * procs.z; }
+
+  // numbering of the regions of tensor/staggered grids (tiled grids: depth-first order of the cut tree)
+  void set_order(RegionOrder numbering) {
+    if (cuts.grid == GridStyle::Tiled and numbering != RegionOrder::RowMajor)
+      error_msg("Region orderings are only supported for tensor and staggered grids\n");
+    order = region_order(procs, numbering);
+    rank_of.assign(order.size(), 0);
+    for (size_t reg = 0; reg < order.size(); ++reg) rank_of[order[reg]] = reg;
+  }
+  long row_major(long reg) const { return order.empty() ? reg : order[reg]; }
+
+  // cell-borders of region reg
+  Cell cell(long reg) const {
+    if (cuts.grid == GridStyle::Tiled) {
+      Cell cell = tree.cell(reg);
+      for (int dim = 0; dim < N_DIMS; ++dim) {
+        cell.low(dim)  += region_gap/2;
+        cell.high(dim) -= region_gap/2;
+      }
+      return cell;
+    }
+    Triple<int> coord = idx_to_coord(row_major(reg));
+    Cell cell;
+    cell.z_low  = cuts.z_cuts[coord.z]     + region_gap/2;
+    cell.z_high = cuts.z_cuts[coord.z + 1] - region_gap/2;
+    if (cuts.grid == GridStyle::Tensor) {
+      cell.y_low  = cuts.y_cuts[coord.y]     + region_gap/2;
+      cell.y_high = cuts.y_cuts[coord.y + 1] - region_gap/2;
+      cell.x_low  = cuts.x_cuts[coord.x]     + region_gap/2;
+      cell.x_high = cuts.x_cuts[coord.x + 1] - region_gap/2;
+    } else if (cuts.grid == GridStyle::Staggered) {
+      size_t y_off = static_cast<size_t>(coord.z) * (procs.y + 1) + coord.y;
+      size_t x_off = (static_cast<size_t>(coord.z) * procs.y + coord.y) * (procs.x + 1) + coord.x;
+      cell.y_low  = cuts.y_cuts[y_off]     + region_gap/2;
+      cell.y_high = cuts.y_cuts[y_off + 1] - region_gap/2;
+      cell.x_low  = cuts.x_cuts[x_off]     + region_gap/2;
+      cell.x_high = cuts.x_cuts[x_off + 1] - region_gap/2;
+    }
+    return cell;
+  }
+
+  // region indices of n points (xyz: x, y, z of every point), without the region gap
+  void locate(const double* xyz, size_t n, int32_t* regions) const {
+    if (cuts.grid == GridStyle::Tiled) tree.locate(xyz, n, regions);
+    else                               cuts.locate(xyz, n, regions);
+    if (not rank_of.empty())
+      for (size_t i = 0; i < n; ++i) regions[i] = rank_of[regions[i]];
+  }
+
+  // cut_params of the grid style: tensor/staggered: zyx cut vectors (as Cuts), tiled: dim,ratio pairs (as RCBTree)
+  static System make(GridStyle grid, Triple<int> procs, Triple<double> lens, const std::vector<double>& cut_params, double region_gap = 0) {
+    if (cut_params.size() != Cuts::n_params(procs.x, procs.y, procs.z, grid))
+      error_msg("The number of cuts does not fit the grid and processor dimensions\n");
+    if (grid == GridStyle::Tiled) return System(procs, lens, RCBTree(cut_params, lens), region_gap);
+    return System(procs, lens, Cuts(procs.x, procs.y, procs.z, grid, cut_params), region_gap);
+  }
+
+  static void write_name(OutBuffer& out, long reg) {
+    out.write("reg");
+    out.write_int(reg, 3);
+  }
+
+  void lmp_style_regions(OutBuffer& out) const {
+    // "region <region-name> <kind=>block <x-low> <x-high> <y-low> <y-high> <z-low> <z-high>"
+    for (long reg = 0; reg < n_regions(); ++reg) {
+      Cell c = cell(reg);
+      out.write("region ");
+      write_name(out, reg);
+      out.write(" block");
+      for (double border : {c.x_low, c.x_high, c.y_low, c.y_high, c.z_low, c.z_high}) {
+        out.write(' ');
+        out.write_fixed(border, 6);
+      }
+      out.write('\n');
+    }
+  }
+
+  void lmp_style_create(OutBuffer& out, const AtomParams& params) const {
+    // "create_atoms <atom_kind=1> random <n-atoms> <seed> <region-name>"
+    long seed = params.creation_seed;
+    for (long reg = 0; reg < n_regions(); ++reg) {
+      out.write("create_atoms 1 random ");
+      out.write_int(params.atoms_per_region);
+      out.write(' ');
+      out.write_int(seed);
+      out.write(' ');
+      write_name(out, reg);
+      out.write('\n');
+      if (params.inc_seed) seed += 1;
+    }
+  }
+
+  // instead of create_atoms: the atoms in a data file, LAMMPS only needs to read_data it
+  void lmp_style_read_data(OutBuffer& out, const std::string& data_fname) const {
+    out.write("read_data ");
+    out.write(data_fname);
+    out.write('\n');
+  }
+
+  // LAMMPS data file (atom style atomic, 1 atom type, box: 0 - lens) with params.atoms_per_region atoms uniformly
+  // distributed in the (gapped) box of every region; the atoms of a region come from the counter-based stream of
+  // the seed create_atoms would get, so the file does not depend on the number of threads
+  // the regions are split into chunks of about 1 MiB (the stream of a chunk starts at the counter of its first
+  // atom), blocks of chunks are generated in parallel and written in order: bounded memory for any region size
+  void write_lmp_data(const std::string& fname, const AtomParams& params) const {
+    std::FILE* file = std::fopen(fname.data(), "w");
+    if (not file) error_msg("unable to open %s\n", fname.data());
+    long n_atoms = params.atoms_per_region * n_regions();
+    std::fprintf(file, "LAMMPS data file via atom_regions\n\n%ld atoms\n1 atom types\n\n"
+                       "0.0 %.6f xlo xhi\n0.0 %.6f ylo yhi\n0.0 %.6f zlo zhi\n\nAtoms # atomic\n\n",
+                 n_atoms, lens.x, lens.y, lens.z);
+
+    // upper bound of the length of an atom line: id, type and 3 coordinates (all within +-(max len + gap))
+    char tmp[352];
+    double max_coord = std::max({lens.x, lens.y, lens.z}) + std::abs(region_gap);
+    size_t coord_len = std::to_chars(tmp, tmp + sizeof(tmp), -max_coord, std::chars_format::fixed, 6).ptr - tmp;
+    size_t line_len = 20 + 3 + 3 * (coord_len + 1) + 1;
+    long chunk_atoms = std::max(1l, static_cast<long>((size_t(1) << 20) / line_len));
+    long region_chunks = (params.atoms_per_region + chunk_atoms - 1) / chunk_atoms;
+    long n_chunks = region_chunks * n_regions();
+    long block = std::max(1l, std::min(64l, n_chunks));
+    std::vector<std::vector<char>> bufs(block, std::vector<char>(chunk_atoms * line_len));
+    std::vector<size_t> lens_written(block);
+
+    for (long first = 0; first < n_chunks; first += block) {
+      long n = std::min(block, n_chunks - first);
+      #pragma omp parallel for schedule(dynamic)
+      for (long i = 0; i < n; ++i) {
+        long reg = (first + i) / region_chunks;
+        long first_atom = ((first + i) % region_chunks) * chunk_atoms;
+        long last_atom = std::min(first_atom + chunk_atoms, params.atoms_per_region);
+        Cell c = cell(reg);
+        CounterRng rng(params.creation_seed + (params.inc_seed ? reg : 0), 0);
+        rng.ctr = N_DIMS * first_atom;
+        char* out = bufs[i].data();
+        for (long atom = first_atom; atom < last_atom; ++atom) {
+          out = std::to_chars(out, out + 20, reg * params.atoms_per_region + atom + 1).ptr;
+          *out++ = ' '; *out++ = '1';
+          for (int dim = 0; dim < N_DIMS; ++dim) {
+            *out++ = ' ';
+            double coord = c.low(dim) + (c.high(dim) - c.low(dim)) * rng.uniform();
+            out = std::to_chars(out, out + coord_len, coord, std::chars_format::fixed, 6).ptr;
+          }
+          *out++ = '\n';
+        }
+        lens_written[i] = out - bufs[i].data();
+      }
+      for (long i = 0; i < n; ++i)
+        if (std::fwrite(bufs[i].data(), 1, lens_written[i], file) != lens_written[i]) error_msg("unable to write %s\n", fname.data());
+    }
+    std::fclose(file);
+  }
+
+  // row-major index (z, y, x)
+  long coord_to_idx(Triple<int> c) const {
+    return (static_cast<long>(c.z) * procs.y + c.y) * procs.x + c.x;
+  }
+
+  Triple<int> idx_to_coord(long idx) const {
+    Triple<int> coord;
+    coord.x = idx % procs.x;
+    coord.y = (idx / procs.x) % procs.y;
+    coord.z = idx / (static_cast<long>(procs.x) * procs.y);
+    return coord;
+  }
+};
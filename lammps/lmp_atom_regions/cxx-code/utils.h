@@ -1,10 +1,17 @@
+#pragma once
+
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <iomanip>
+#include <charconv>
+#include <string_view>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 
 std::string to_wdtstr(int i, int wdt) {
   std::stringstream sstr;
@@ -26,3 +33,83 @@ std::vector<std::string> toStrVec(int argc, char* argv[]) {
   std::transform(argv, argv+argc, res.begin(), [](const char* s) { return std::string(s); });
   return res;
 }
+
+bool parse_bool(const std::string& s) {
+  if (s == "y" || s == "yes" || s == "true" || s == "1" || s == "on")  return true;
+  if (s == "n" || s == "no" || s == "false" || s == "0" || s == "off") return false;
+  error_msg("invalid bool value: %s\n", s.data());
+  return false;
+}
+
+std::vector<double> parse_csv(const std::string& s) {
+  std::vector<double> res;
+  const char* pos = s.data();
+  while (*pos) {
+    char* end;
+    res.push_back(std::strtod(pos, &end));
+    if (end == pos || (*end && *end != ',')) error_msg("invalid csv value: %s\n", pos);
+    pos = *end ? end + 1 : end;
+  }
+  return res;
+}
+
+// fixed size output buffer, written in large chunks (memory use independent of the amount of output)
+struct OutBuffer {
+  std::vector<char> buf;
+  size_t pos = 0;
+  std::FILE* file;
+
+  OutBuffer(std::FILE* file = stdout, size_t size = 1 << 22) : buf(size), file{file} { }
+  ~OutBuffer() { flush(); }
+
+  void flush() {
+    if (pos and std::fwrite(buf.data(), 1, pos, file) != pos) error_msg("unable to write output\n");
+    pos = 0;
+  }
+  // pointer to at least n free chars
+  char* reserve(size_t n) {
+    if (pos + n > buf.size()) flush();
+    return buf.data() + pos;
+  }
+
+  void write(std::string_view s) {
+    if (s.size() > buf.size()) { flush(); std::fwrite(s.data(), 1, s.size(), file); return; }
+    std::memcpy(reserve(s.size()), s.data(), s.size());
+    pos += s.size();
+  }
+  void write(char c) { *reserve(1) = c; ++pos; }
+  // zero padded to wdt digits (as to_wdtstr)
+  void write_int(long val, int wdt = 0) {
+    char* out = reserve(32);
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), val < 0 ? -val : val).ptr;
+    if (val < 0) *out++ = '-';
+    for (long i = end - digits; i < wdt; ++i) *out++ = '0';
+    out = std::copy(digits, end, out);
+    pos = out - buf.data();
+  }
+  // fixed notation with precision digits after the point (as printf's %.<precision>f)
+  void write_fixed(double val, int precision) {
+    char* out = reserve(352);
+    pos = std::to_chars(out, out + 352, val, std::chars_format::fixed, precision).ptr - buf.data();
+  }
+};
+
+// counter-based generator (SplitMix64 finalizer of key + counter, also used by random_cuts): independent streams
+// that give the same numbers regardless of the thread generating them; ctr can be set to start a stream at an offset
+struct CounterRng {
+  uint64_t key, ctr = 0;
+
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  CounterRng(uint64_t seed, uint64_t stream) : key{mix(mix(seed) + stream * 0x9e3779b97f4a7c15ull)} { }
+
+  uint64_t next() { return mix(key + (++ctr) * 0x9e3779b97f4a7c15ull); }
+  // uniform in [0, n)
+  uint32_t below(uint32_t n) { return static_cast<uint32_t>((static_cast<unsigned __int128>(next()) * n) >> 64); }
+  // uniform in [0, 1)
+  double uniform() { return (next() >> 11) * 0x1.0p-53; }
+};
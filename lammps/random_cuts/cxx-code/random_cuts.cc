@@ -1,61 +1,88 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <random>
 #include <algorithm>
-#include <iterator>
-#include <ctime>
-#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "grids.h"   // UnitCuts and its output (lmp_atom_regions/cxx-code)
 
 using namespace std;
 
-#define MIN_DISTANCE 0.025
-
-/*
-float rnd(float min=0.0, float max=1.0) {
-  return (rand() * 1.0 / RAND_MAX) * (max - min) + min;
-}
-*/
-
+#define USAGE "./random_cuts [--batch <n-sets>] <csv|lmp-balance> <tensor|staggered|tiled> <nx> <ny> <nz> <min-dist> [<seed>]"
 
 int main(int argc, char* argv[]) {
   std::random_device rnd_dev;
-  int seed = rnd_dev();
+  uint64_t seed = rnd_dev();
+
+  // batch mode: --batch <n-sets> -> one line per set, set i generated with the seed (seed, i)
+  long n_sets = 0;
+  if (argc > 2 && std::strcmp(argv[1], "--batch") == 0) {
+    n_sets = std::atol(argv[2]);
+    if (n_sets < 1) { std::cout << "ERROR: number of cut sets must be positive!" << std::endl; std::exit(1); }
+    argv += 2;
+    argc -= 2;
+  }
 
   int nargs = argc-1;
-  if (nargs < 3) {
-    std::cout << "ERROR: at least three parameters (proc grid dims) required (plus optional random seed)!" << std::endl; std::exit(1);
-  } else if (nargs > 4) {
-    std::cout << "ERROR: too many arguments: three or four parameters required!" << std::endl; std::exit(1);
-  } else if (nargs == 4) {
-    seed = std::atoi(argv[nargs]);
+  if (nargs == 0 || std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0) {
+    std::cout << "usage: " << USAGE << std::endl; std::exit(0);
+  } else if (nargs < 6) {
+    std::cout << "ERROR: missing arguments\nusage: " << USAGE << std::endl; std::exit(1);
+  } else if (nargs > 7) {
+    std::cout << "ERROR: too many arguments\nusage: " << USAGE << std::endl; std::exit(1);
+  } else if (nargs == 7) {
+    seed = std::atoll(argv[7]);
   }
 
-  std::mt19937 rng(seed);
-  std::uniform_real_distribution<float> runif(MIN_DISTANCE, 1-MIN_DISTANCE);
+  OutputMode mode;
+  UnitCuts grid;
+  if (std::strcmp(argv[1], "csv") == 0)              mode = OutputMode::Csv;
+  else if (std::strcmp(argv[1], "lmp-balance") == 0) mode = OutputMode::LmpBalance;
+  else { std::cout << "ERROR: invalid output mode: " << argv[1] << std::endl; std::exit(1); }
+  if (std::strcmp(argv[2], "tensor") == 0)         grid.style = GridStyle::Tensor;
+  else if (std::strcmp(argv[2], "staggered") == 0) grid.style = GridStyle::Staggered;
+  else if (std::strcmp(argv[2], "tiled") == 0)     grid.style = GridStyle::Tiled;
+  else { std::cout << "ERROR: invalid grid style: " << argv[2] << std::endl; std::exit(1); }
+  if (mode == OutputMode::LmpBalance && grid.style != GridStyle::Tensor) {
+    std::cout << "ERROR: The `lmp-balance` output mode only works for tensor grid" << std::endl; std::exit(1);
+  }
+  double min_dist = std::atof(argv[6]);
+  for (int comp = 0; comp < 3; ++comp) {
+    grid.dims[comp] = std::atoi(argv[comp+3]);
+    if (grid.dims[comp] < 1) { std::cout << "ERROR: Only 3D grids are supported! (minimal dims: 1x1x1)" << std::endl; std::exit(1); }
+    if (1.0 / grid.dims[comp] <= min_dist) { std::cout << "ERROR: Minimal distance is too large" << std::endl; std::exit(1); }
+  }
+  grid.min_dist = static_cast<uint32_t>(min_dist * UNITS + 0.5);
 
-  std::vector<std::string> comp_names {"x", "y", "z"};
-  std::stringstream output;
+  auto append_output = [&](std::string& out, const UnitCuts& g) {
+    if (mode == OutputMode::Csv) append_csv(out, g);
+    else                         append_lmp_balance(out, g);
+    out += '\n';
+  };
 
-  for (int comp = 0; comp < 3; ++comp) {
-    output << comp_names[comp] << " ";
-    int n = std::atoi(argv[comp+1]);
-    std::vector<float> cuts(n-1);
-    bool valid;
-    do {
-      std::generate(cuts.begin(), cuts.end(), [&](){ return runif(rng); });
-      std::sort(cuts.begin(), cuts.end());
-      // check that cuts are not too close ; otherwise regenerate last cut
-      valid = true;
-      for (int i = 0; i < cuts.size()-1; ++i)
-        if (std::abs(cuts[i] - cuts[i+1]) < MIN_DISTANCE)
-          valid = false;
-    } while (!valid);
-    std::copy(cuts.begin(), cuts.end(), std::ostream_iterator<float>(output, " "));
+  if (n_sets == 0) {
+    std::string out;
+    grid.generate(seed, true);
+    append_output(out, grid);
+    fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
   }
 
-  std::cout << output.str() << std::endl;
+  // sets in parallel (each generated serially), written in order in blocks of 1024 sets
+  const long block = 1024;
+  std::vector<std::string> outs(block);
+  for (long first = 0; first < n_sets; first += block) {
+    long n = std::min(block, n_sets - first);
+    #pragma omp parallel for schedule(dynamic, 8) firstprivate(grid)
+    for (long set = 0; set < n; ++set) {
+      outs[set].clear();
+      grid.generate(CounterRng::mix(seed) ^ CounterRng::mix(first + set + 1), false);
+      append_output(outs[set], grid);
+    }
+    for (long set = 0; set < n; ++set) fwrite(outs[set].data(), 1, outs[set].size(), stdout);
+  }
 
   return 0;
 }